@@ -0,0 +1,41 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+// The six clip planes of a projection * view matrix, extracted with the Gribb/Hartmann method.
+// Planes point inwards and are normalized, so dot(plane, vec4(p, 1)) is a signed distance.
+class Frustum
+{
+public:
+    glm::vec4 planes[6]; // left, right, bottom, top, near, far
+
+    Frustum() { }
+
+    explicit Frustum(const glm::mat4 &viewProjection)
+    {
+        // glm matrices are column major: row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        for (int i = 0; i < 3; i++)
+        {
+            planes[2 * i] = rows[3] + rows[i];
+            planes[2 * i + 1] = rows[3] - rows[i];
+        }
+        for (int i = 0; i < 6; i++)
+            planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+
+    // true if any part of the sphere may be visible
+    bool intersectsSphere(const glm::vec3 &center, float radius) const
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+                return false;
+        }
+        return true;
+    }
+};
+#endif
@@ -0,0 +1,259 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+// Shadow copy of the GL state the renderer touches every frame: the program, the vertex array,
+// the textures of the first units, the framebuffers, the viewport and the blend, depth and
+// color mask state. Every call compares against it and only reaches GL when it changes
+// something, so drawing code can set what it needs without knowing what was set before.
+//
+// It only knows what went through it: everything starts unknown (the first call always goes
+// to GL), and code that changes the same state with raw GL calls, or deletes a bound object,
+// has to call invalidate() afterwards.
+class GLState
+{
+public:
+    static const unsigned int TEXTURE_UNITS = 32; // units tracked, the others are passed through
+
+    // state calls of a frame, and how many of them were dropped as redundant
+    struct Stats
+    {
+        unsigned int calls;
+        unsigned int eliminated;
+    };
+
+    static GLState& instance()
+    {
+        static GLState state;
+        return state;
+    }
+
+    void useProgram(GLuint program)
+    {
+        if (this->changes(this->program, program))
+            glUseProgram(program);
+    }
+
+    void bindVertexArray(GLuint vao)
+    {
+        if (this->changes(this->vertexArray, vao))
+            glBindVertexArray(vao);
+    }
+
+    // GL_TEXTURE0 + unit, like glActiveTexture
+    void activeTexture(GLenum texture)
+    {
+        if (this->changes(this->activeUnit, texture - GL_TEXTURE0))
+            glActiveTexture(texture);
+    }
+
+    // binds to the active unit, like glBindTexture
+    void bindTexture(GLenum target, GLuint texture)
+    {
+        GLuint *bound = this->textureSlot(this->activeUnit, target);
+        if (!bound)
+        {
+            this->stats.calls++;
+            glBindTexture(target, texture);
+        }
+        else if (this->changes(*bound, texture))
+            glBindTexture(target, texture);
+    }
+
+    // selects the unit and binds the texture to it; nothing at all when it is bound there
+    // already, so select the unit with activeTexture() before changing the texture itself
+    void bindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        GLuint *bound = this->textureSlot(unit, target);
+        if (bound && *bound == texture)
+        {
+            this->stats.calls += 2;
+            this->stats.eliminated += 2;
+            return;
+        }
+        this->activeTexture(GL_TEXTURE0 + unit);
+        this->bindTexture(target, texture);
+    }
+
+    // GL_FRAMEBUFFER sets both the draw and the read framebuffer, like glBindFramebuffer
+    void bindFramebuffer(GLenum target, GLuint framebuffer)
+    {
+        bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+        bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+        this->stats.calls++;
+        if ((!draw || this->drawFramebuffer == framebuffer) && (!read || this->readFramebuffer == framebuffer))
+        {
+            this->stats.eliminated++;
+            return;
+        }
+        if (draw)
+            this->drawFramebuffer = framebuffer;
+        if (read)
+            this->readFramebuffer = framebuffer;
+        glBindFramebuffer(target, framebuffer);
+    }
+
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        GLint next[4] = { x, y, width, height };
+        if (this->changes(this->viewportBox, next, 4))
+            glViewport(x, y, width, height);
+    }
+
+    void enable(GLenum capability)
+    {
+        if (this->changes(this->capability(capability), (GLuint)GL_TRUE))
+            glEnable(capability);
+    }
+
+    void disable(GLenum capability)
+    {
+        if (this->changes(this->capability(capability), (GLuint)GL_FALSE))
+            glDisable(capability);
+    }
+
+    void blendFunc(GLenum source, GLenum destination)
+    {
+        GLenum next[4] = { source, destination, source, destination };
+        if (this->changes(this->blend, next, 4))
+            glBlendFunc(source, destination);
+    }
+
+    void blendFuncSeparate(GLenum sourceRGB, GLenum destinationRGB, GLenum sourceAlpha, GLenum destinationAlpha)
+    {
+        GLenum next[4] = { sourceRGB, destinationRGB, sourceAlpha, destinationAlpha };
+        if (this->changes(this->blend, next, 4))
+            glBlendFuncSeparate(sourceRGB, destinationRGB, sourceAlpha, destinationAlpha);
+    }
+
+    void depthFunc(GLenum func)
+    {
+        if (this->changes(this->depth, func))
+            glDepthFunc(func);
+    }
+
+    void depthMask(GLboolean flag)
+    {
+        if (this->changes(this->depthWrite, (GLuint)flag))
+            glDepthMask(flag);
+    }
+
+    void colorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+    {
+        GLuint next[4] = { red, green, blue, alpha };
+        if (this->changes(this->colorWrite, next, 4))
+            glColorMask(red, green, blue, alpha);
+    }
+
+    // forgets everything, the next call of each kind goes to GL
+    void invalidate()
+    {
+        this->program = this->vertexArray = this->activeUnit = UNKNOWN;
+        this->drawFramebuffer = this->readFramebuffer = UNKNOWN;
+        this->depth = this->depthWrite = UNKNOWN;
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            this->viewportBox[i] = -1;
+            this->blend[i] = UNKNOWN;
+            this->colorWrite[i] = UNKNOWN;
+        }
+        for (unsigned int i = 0; i < TEXTURE_UNITS; i++)
+            this->texture2D[i] = this->textureCube[i] = UNKNOWN;
+        this->capabilities.clear();
+    }
+
+    // closes the frame's statistics, lastFrame() returns them until the next call
+    void endFrame()
+    {
+        this->last = this->stats;
+        this->stats.calls = this->stats.eliminated = 0;
+    }
+
+    const Stats& lastFrame() const
+    {
+        return this->last;
+    }
+
+private:
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+    Stats stats, last;
+    GLuint program, vertexArray, activeUnit;
+    GLuint drawFramebuffer, readFramebuffer;
+    GLuint texture2D[TEXTURE_UNITS], textureCube[TEXTURE_UNITS];
+    GLint viewportBox[4];
+    GLenum blend[4];
+    GLuint depth, depthWrite, colorWrite[4];
+    std::vector<std::pair<GLenum, GLuint> > capabilities; // the few ever toggled, searched linearly
+
+    GLState()
+    {
+        this->stats.calls = this->stats.eliminated = 0;
+        this->last = this->stats;
+        this->invalidate();
+    }
+
+    // counts the call, true when it changes current (which is then updated)
+    template <class T>
+    bool changes(T &current, T next)
+    {
+        this->stats.calls++;
+        if (current == next)
+        {
+            this->stats.eliminated++;
+            return false;
+        }
+        current = next;
+        return true;
+    }
+
+    template <class T>
+    bool changes(T *current, const T *next, unsigned int count)
+    {
+        this->stats.calls++;
+        bool equal = true;
+        for (unsigned int i = 0; i < count; i++)
+            equal = equal && current[i] == next[i];
+        if (equal)
+        {
+            this->stats.eliminated++;
+            return false;
+        }
+        for (unsigned int i = 0; i < count; i++)
+            current[i] = next[i];
+        return true;
+    }
+
+    // NULL for the units and targets that are not tracked
+    GLuint* textureSlot(GLuint unit, GLenum target)
+    {
+        if (unit >= TEXTURE_UNITS)
+            return NULL;
+        if (target == GL_TEXTURE_2D)
+            return &this->texture2D[unit];
+        if (target == GL_TEXTURE_CUBE_MAP)
+            return &this->textureCube[unit];
+        return NULL;
+    }
+
+    GLuint& capability(GLenum capability)
+    {
+        for (unsigned int i = 0; i < this->capabilities.size(); i++)
+        {
+            if (this->capabilities[i].first == capability)
+                return this->capabilities[i].second;
+        }
+        this->capabilities.push_back(std::make_pair(capability, GLuint(UNKNOWN)));
+        return this->capabilities.back().second;
+    }
+};
+
+// shorthand for the drawing code
+inline GLState& glState()
+{
+    return GLState::instance();
+}
+#endif
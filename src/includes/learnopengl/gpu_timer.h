@@ -0,0 +1,77 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+// Measures the GPU time spent between begin() and end() with GL_TIME_ELAPSED queries.
+// Every frame uses the next query of a small ring and a query is only read back when its
+// slot comes around again, so the results lag a few frames behind but never stall the
+// pipeline. Only one timer can be running at a time (a GL restriction on elapsed queries).
+class GpuTimer
+{
+public:
+    static const unsigned int LATENCY = 4; // frames in flight before a result is read
+
+    GpuTimer() : current(0), totalNanoseconds(0), samples(0)
+    {
+        glGenQueries(LATENCY, this->queries);
+        for (unsigned int i = 0; i < LATENCY; i++)
+            this->issued[i] = false;
+    }
+
+    void begin()
+    {
+        // collect the result this slot got LATENCY frames ago before reusing it
+        GLuint query = this->queries[this->current];
+        if (this->issued[this->current])
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+                this->totalNanoseconds += elapsed;
+                this->samples++;
+            }
+        }
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        this->issued[this->current] = true;
+    }
+
+    void end()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        this->current = (this->current + 1) % LATENCY;
+    }
+
+    // average milliseconds of the samples collected since the last reset()
+    double milliseconds() const
+    {
+        return this->samples ? this->totalNanoseconds / 1.0e6 / this->samples : 0.0;
+    }
+
+    unsigned int sampleCount() const
+    {
+        return this->samples;
+    }
+
+    void reset()
+    {
+        this->totalNanoseconds = 0;
+        this->samples = 0;
+    }
+
+    void deleteQueries()
+    {
+        glDeleteQueries(LATENCY, this->queries);
+    }
+
+private:
+    GLuint queries[LATENCY];
+    bool issued[LATENCY];
+    unsigned int current;
+    GLuint64 totalNanoseconds;
+    unsigned int samples;
+};
+#endif
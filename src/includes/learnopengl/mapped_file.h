@@ -0,0 +1,130 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A whole file mapped read-only into memory. The pages are read in by the kernel as they are
+// touched, so data can be handed to GL (or hashed) straight from the mapping without a copy.
+class MappedFile
+{
+public:
+    MappedFile() : base(NULL), length(0)
+    {
+#ifdef _WIN32
+        this->fileHandle = INVALID_HANDLE_VALUE;
+        this->mapping = NULL;
+#endif
+    }
+
+    ~MappedFile()
+    {
+        this->close();
+    }
+
+    // false when the file is missing, empty or cannot be mapped
+    bool open(const std::string &path)
+    {
+        this->close();
+#ifdef _WIN32
+        this->fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (this->fileHandle == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER bytes;
+        GetFileSizeEx(this->fileHandle, &bytes);
+        this->mapping = bytes.QuadPart > 0 ? CreateFileMappingA(this->fileHandle, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+        this->base = this->mapping ? (const unsigned char*)MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+        if (!this->base)
+        {
+            if (this->mapping)
+                CloseHandle(this->mapping);
+            CloseHandle(this->fileHandle);
+            this->mapping = NULL;
+            this->fileHandle = INVALID_HANDLE_VALUE;
+            return false;
+        }
+        this->length = (size_t)bytes.QuadPart;
+        return true;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        void *mapped = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+            mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping keeps the file alive
+        if (mapped == MAP_FAILED)
+            return false;
+        // read from front to back, like the uploads and the hash do
+        madvise(mapped, (size_t)info.st_size, MADV_SEQUENTIAL);
+        this->base = (const unsigned char*)mapped;
+        this->length = (size_t)info.st_size;
+        return true;
+#endif
+    }
+
+    void close()
+    {
+        if (!this->base)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(this->base);
+        CloseHandle(this->mapping);
+        CloseHandle(this->fileHandle);
+        this->mapping = NULL;
+        this->fileHandle = INVALID_HANDLE_VALUE;
+#else
+        munmap((void*)this->base, this->length);
+#endif
+        this->base = NULL;
+        this->length = 0;
+    }
+
+    bool isOpen() const
+    {
+        return this->base != NULL;
+    }
+
+    const unsigned char* data() const
+    {
+        return this->base;
+    }
+
+    size_t size() const
+    {
+        return this->length;
+    }
+
+    // reads every page in now, so that whoever uses the data later does not wait for the disk
+    void prefetch() const
+    {
+        volatile unsigned char sink = 0;
+        for (size_t i = 0; i < this->length; i += 4096)
+            sink ^= this->base[i];
+        (void)sink;
+    }
+
+private:
+    const unsigned char *base;
+    size_t length;
+#ifdef _WIN32
+    HANDLE fileHandle, mapping;
+#endif
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+#endif
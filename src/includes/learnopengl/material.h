@@ -0,0 +1,67 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader_m.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// one texture of a material and the unit it is bound to
+struct MaterialTexture {
+    GLuint unit;
+    GLuint texture;
+    std::string sampler; // e.g. texture_diffuse1, only read when a new program is seen
+};
+
+// The textures of a mesh resolved once at load time into (unit, texture) pairs. The sampler
+// uniforms that read them are looked up the first time the material is bound with a program
+// and kept per program, so binding it afterwards is a couple of glUniform1i and (redundant
+// ones dropped by GLState) texture binds, without any string work.
+class Material {
+public:
+    // meshes with the same id share the textures, draws sorted by id only bind each one once
+    unsigned int id;
+    std::vector<MaterialTexture> textures;
+
+    Material() : id(0), programs(std::make_shared<std::vector<ProgramSamplers> >()) { }
+
+    void bind(const Shader &shader) const
+    {
+        const std::vector<Uniform<int> > &samplers = this->samplersOf(shader);
+        for (unsigned int i = 0; i < this->textures.size(); i++)
+        {
+            shader.set(samplers[i], (int)this->textures[i].unit);
+            glState().bindTexture(this->textures[i].unit, GL_TEXTURE_2D, this->textures[i].texture);
+        }
+    }
+
+private:
+    // sampler locations of every texture in one program
+    struct ProgramSamplers {
+        GLuint program;
+        std::vector<Uniform<int> > locations;
+    };
+    // a handful of programs at most, shared by the copies of the material like Shader's uniforms
+    std::shared_ptr<std::vector<ProgramSamplers> > programs;
+
+    const std::vector<Uniform<int> >& samplersOf(const Shader &shader) const
+    {
+        std::vector<ProgramSamplers> &known = *this->programs;
+        for (unsigned int i = 0; i < known.size(); i++)
+        {
+            if (known[i].program == shader.ID)
+                return known[i].locations;
+        }
+        ProgramSamplers resolved;
+        resolved.program = shader.ID;
+        for (unsigned int i = 0; i < this->textures.size(); i++)
+            resolved.locations.push_back(shader.uniform<int>(this->textures[i].sampler.c_str()));
+        known.push_back(resolved);
+        return known.back().locations;
+    }
+};
+#endif
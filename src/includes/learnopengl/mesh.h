@@ -6,12 +6,15 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-#include <learnopengl/shader.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/material.h>
+#include <learnopengl/shader_m.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <utility>
 #include <vector>
 using namespace std;
 
@@ -34,37 +37,102 @@ struct Texture {
     string path;
 };
 
+// a mesh as an importer produces it, before anything is uploaded
+struct MeshData {
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<Texture> textures; // type and path only, loaded by the model when it uploads the mesh
+    unsigned int materialIndex;
+};
+
 class Mesh {
 public:
     /*  Mesh Data  */
     vector<Vertex> vertices;
     vector<unsigned int> indices;
     vector<Texture> textures;
+    Material material; // the textures above, resolved to units
+    unsigned int indexCount; // drawn by DrawElements()
     unsigned int VAO;
 
     /*  Functions  */
     // constructor
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+        : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures))
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
-
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+        setupMaterial();
+    }
+
+    // uploads data that lives elsewhere, e.g. in a mapped MeshCache file; vertices and indices stay empty
+    Mesh(const Vertex *vertices, unsigned int vertexCount, const unsigned int *indices, unsigned int indexCount, vector<Texture> textures)
+        : textures(std::move(textures))
+    {
+        setupMesh(vertices, vertexCount, indices, indexCount);
+        setupMaterial();
+    }
+
+    // a mesh owns its GL objects: it can be moved into a model but never copied
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh(Mesh &&other) noexcept
+        : vertices(std::move(other.vertices)), indices(std::move(other.indices)), textures(std::move(other.textures)),
+          material(std::move(other.material)), indexCount(other.indexCount), VAO(other.VAO), VBO(other.VBO), EBO(other.EBO)
+    {
+        other.VAO = other.VBO = other.EBO = 0;
+    }
+    Mesh& operator=(Mesh &&other) noexcept
+    {
+        std::swap(vertices, other.vertices);
+        std::swap(indices, other.indices);
+        std::swap(textures, other.textures);
+        std::swap(material, other.material);
+        std::swap(indexCount, other.indexCount);
+        std::swap(VAO, other.VAO);
+        std::swap(VBO, other.VBO);
+        std::swap(EBO, other.EBO);
+        return *this;
     }
 
     // render the mesh
-    void Draw(Shader shader) 
+    void Draw(const Shader &shader) const
+    {
+        material.bind(shader);
+        DrawElements();
+    }
+
+    // render the mesh with the textures that are bound, see Model::Draw
+    void DrawElements() const
+    {
+        // the VAO stays bound, GLState drops the bind when the next draw uses it too
+        glState().bindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+    }
+
+    // deletes the buffers and the vertex array, the textures belong to the model
+    void deleteBuffers()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        VAO = VBO = EBO = 0;
+    }
+
+private:
+    /*  Render data  */
+    unsigned int VBO, EBO;
+
+    /*  Functions    */
+    // gives every texture the next unit and names its sampler once, Draw() runs every frame
+    void setupMaterial()
     {
-        // bind appropriate textures
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -76,45 +144,33 @@ public:
 				number = std::to_string(normalNr++); // transfer unsigned int to stream
              else if(name == "texture_height")
 			    number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-													 // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            MaterialTexture texture;
+            texture.unit = i;
+            texture.texture = textures[i].id;
+            texture.sampler = name + number;
+            material.textures.push_back(texture);
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
-private:
-    /*  Render data  */
-    unsigned int VBO, EBO;
-
-    /*  Functions    */
     // initializes all the buffer objects/arrays
-    void setupMesh()
+    void setupMesh(const Vertex *vertices, size_t vertexCount, const unsigned int *indices, size_t indexCount)
     {
+        this->indexCount = (unsigned int)indexCount;
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
+        glState().bindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertices, GL_STATIC_DRAW);  
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indices, GL_STATIC_DRAW);
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -133,7 +189,7 @@ private:
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
 
-        glBindVertexArray(0);
+        glState().bindVertexArray(0);
     }
 };
 #endif
@@ -0,0 +1,357 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <learnopengl/mapped_file.h>
+#include <learnopengl/mesh.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Layout of a mesh cache file, offsets are from the start of the file:
+//   MeshCacheHeader
+//   MeshCacheRecord[meshCount]
+//   MeshCacheTexture[textureCount]
+//   the texture types and paths, not terminated
+//   per mesh its vertices as uploaded (Vertex records) then its indices (uint32), 16 byte aligned
+// The version is part of the magic, bump it when the layout or the import flags change.
+const char MESH_CACHE_MAGIC[8] = { 'M', 'E', 'S', 'H', 'C', '0', '0', '1' };
+
+struct MeshCacheHeader
+{
+    char magic[8];
+    uint64_t sourceHash;   // MeshCache::sourceHash() of what it was imported from
+    uint64_t size;         // of the whole file, a truncated file is a miss
+    uint32_t vertexSize;   // sizeof(Vertex) of the build that wrote it
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint32_t padding;
+};
+
+struct MeshCacheRecord
+{
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t materialIndex; // of the source scene, meshes sharing it share their textures
+    uint32_t firstTexture;
+    uint32_t textureCount;
+    uint32_t padding;
+};
+
+struct MeshCacheTexture
+{
+    uint64_t typeOffset; // texture_diffuse, texture_specular, ...
+    uint64_t pathOffset; // relative to the model's directory, as the material names it
+    uint32_t typeLength;
+    uint32_t pathLength;
+};
+
+// A mapped cache file whose records were checked against its size, see MeshCache::open().
+class MeshCacheFile
+{
+public:
+    MeshCacheFile() : header(NULL) { }
+
+    unsigned int meshCount() const
+    {
+        return this->header->meshCount;
+    }
+
+    const MeshCacheRecord& mesh(unsigned int i) const
+    {
+        return this->records()[i];
+    }
+
+    const Vertex* vertices(const MeshCacheRecord &mesh) const
+    {
+        return (const Vertex*)(this->file.data() + mesh.vertexOffset);
+    }
+
+    const unsigned int* indices(const MeshCacheRecord &mesh) const
+    {
+        return (const unsigned int*)(this->file.data() + mesh.indexOffset);
+    }
+
+    std::string textureType(unsigned int t) const
+    {
+        const MeshCacheTexture &texture = this->textures()[t];
+        return std::string((const char*)this->file.data() + texture.typeOffset, texture.typeLength);
+    }
+
+    std::string texturePath(unsigned int t) const
+    {
+        const MeshCacheTexture &texture = this->textures()[t];
+        return std::string((const char*)this->file.data() + texture.pathOffset, texture.pathLength);
+    }
+
+    // reads the whole file in, see MappedFile::prefetch()
+    void prefetch() const
+    {
+        this->file.prefetch();
+    }
+
+private:
+    friend class MeshCache;
+    MappedFile file;
+    const MeshCacheHeader *header;
+
+    const MeshCacheRecord* records() const
+    {
+        return (const MeshCacheRecord*)(this->file.data() + sizeof(MeshCacheHeader));
+    }
+
+    const MeshCacheTexture* textures() const
+    {
+        return (const MeshCacheTexture*)(this->records() + this->header->meshCount);
+    }
+
+    // maps path and checks that every record stays inside the file
+    bool map(const std::string &path, uint64_t sourceHash)
+    {
+        if (!this->file.open(path) || this->file.size() < sizeof(MeshCacheHeader))
+            return false;
+        this->header = (const MeshCacheHeader*)this->file.data();
+        uint64_t size = this->file.size();
+        if (memcmp(this->header->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 || this->header->size != size ||
+            this->header->sourceHash != sourceHash || this->header->vertexSize != sizeof(Vertex))
+            return false;
+        uint64_t tables = sizeof(MeshCacheHeader) + (uint64_t)this->header->meshCount * sizeof(MeshCacheRecord) +
+                          (uint64_t)this->header->textureCount * sizeof(MeshCacheTexture);
+        if (tables > size)
+            return false;
+        for (unsigned int i = 0; i < this->header->meshCount; i++)
+        {
+            const MeshCacheRecord &mesh = this->records()[i];
+            if (mesh.vertexOffset % 16 != 0 || mesh.indexOffset % 16 != 0 ||
+                mesh.vertexOffset + (uint64_t)mesh.vertexCount * sizeof(Vertex) > size ||
+                mesh.indexOffset + (uint64_t)mesh.indexCount * sizeof(unsigned int) > size ||
+                (uint64_t)mesh.firstTexture + mesh.textureCount > this->header->textureCount)
+                return false;
+        }
+        for (unsigned int t = 0; t < this->header->textureCount; t++)
+        {
+            const MeshCacheTexture &texture = this->textures()[t];
+            if (texture.typeOffset + texture.typeLength > size || texture.pathOffset + texture.pathLength > size)
+                return false;
+        }
+        return true;
+    }
+
+    MeshCacheFile(const MeshCacheFile&);
+    MeshCacheFile& operator=(const MeshCacheFile&);
+};
+
+// Imported models saved as the meshes Model uploads, so later launches map the file and hand
+// the vertex and index data to GL without going through Assimp. A cache is keyed by the path
+// of the model and checked against a hash of the model file and of the material libraries it
+// names: an edited model is imported again and its cache rewritten. Off until enable() is called.
+// Models may be imported on several threads at once, each with its own path.
+class MeshCache
+{
+public:
+    std::atomic<unsigned int> hits, misses;
+
+    static MeshCache& instance()
+    {
+        static MeshCache cache;
+        return cache;
+    }
+
+    // keeps the caches in directory, created if missing
+    void enable(const std::string &directory)
+    {
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+        this->directory = directory;
+    }
+
+    bool enabled() const
+    {
+        return !this->directory.empty();
+    }
+
+    // Hash of the model at path and, for an OBJ, of the .mtl files its mtllib lines name.
+    // 0 when the model cannot be read.
+    uint64_t sourceHash(const std::string &path) const
+    {
+        MappedFile source;
+        if (!source.open(path))
+            return 0;
+        uint64_t h = contentHash(source.data(), source.size());
+        std::string directory = path.substr(0, path.find_last_of('/') + 1);
+        const char *text = (const char*)source.data();
+        const char *end = text + source.size();
+        for (const char *line = text; line < end; )
+        {
+            const char *next = (const char*)memchr(line, '\n', end - line);
+            next = next ? next + 1 : end;
+            if (next - line > 7 && strncmp(line, "mtllib ", 7) == 0)
+            {
+                std::string library(line + 7, next - line - 7);
+                while (!library.empty() && (library[library.size() - 1] == '\n' || library[library.size() - 1] == '\r' || library[library.size() - 1] == ' '))
+                    library.erase(library.size() - 1);
+                MappedFile material;
+                if (material.open(directory + library))
+                    h = contentHash(material.data(), material.size(), h);
+            }
+            line = next;
+        }
+        return h;
+    }
+
+    // Maps the cache of the model at path. False (a miss) when there is none or it was
+    // written from another version of the source.
+    bool open(const std::string &path, uint64_t sourceHash, MeshCacheFile &cached)
+    {
+        if (!this->enabled() || sourceHash == 0 || !cached.map(this->path(path), sourceHash))
+        {
+            cached.file.close();
+            this->misses++;
+            return false;
+        }
+        this->hits++;
+        return true;
+    }
+
+    // saves the meshes of a model imported from path
+    void store(const std::string &path, uint64_t sourceHash, const std::vector<MeshData> &meshes) const
+    {
+        if (!this->enabled() || sourceHash == 0)
+            return;
+        MeshCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+        header.sourceHash = sourceHash;
+        header.vertexSize = sizeof(Vertex);
+        header.meshCount = (uint32_t)meshes.size();
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            header.textureCount += (uint32_t)meshes[i].textures.size();
+
+        // the tables and strings first, the data blobs after them
+        std::vector<MeshCacheRecord> records(meshes.size());
+        std::vector<MeshCacheTexture> textures(header.textureCount);
+        std::string strings;
+        uint64_t stringsOffset = sizeof(MeshCacheHeader) + records.size() * sizeof(MeshCacheRecord) + textures.size() * sizeof(MeshCacheTexture);
+        unsigned int t = 0;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            records[i].firstTexture = t;
+            records[i].textureCount = (uint32_t)meshes[i].textures.size();
+            records[i].materialIndex = meshes[i].materialIndex;
+            records[i].padding = 0;
+            for (unsigned int j = 0; j < meshes[i].textures.size(); j++, t++)
+            {
+                const Texture &texture = meshes[i].textures[j];
+                textures[t].typeOffset = stringsOffset + strings.size();
+                textures[t].typeLength = (uint32_t)texture.type.size();
+                strings += texture.type;
+                textures[t].pathOffset = stringsOffset + strings.size();
+                textures[t].pathLength = (uint32_t)texture.path.size();
+                strings += texture.path;
+            }
+        }
+        uint64_t offset = align(stringsOffset + strings.size());
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            records[i].vertexOffset = offset;
+            records[i].vertexCount = (uint32_t)meshes[i].vertices.size();
+            offset = align(offset + meshes[i].vertices.size() * sizeof(Vertex));
+            records[i].indexOffset = offset;
+            records[i].indexCount = (uint32_t)meshes[i].indices.size();
+            offset = align(offset + meshes[i].indices.size() * sizeof(unsigned int));
+        }
+        header.size = offset;
+
+        // written aside and renamed, a crash never leaves a partial cache behind
+        std::string target = this->path(path);
+        std::string temporary = target + ".tmp";
+        std::ofstream file(temporary.c_str(), std::ios::binary);
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)records.data(), records.size() * sizeof(MeshCacheRecord));
+        file.write((const char*)textures.data(), textures.size() * sizeof(MeshCacheTexture));
+        file.write(strings.data(), strings.size());
+        pad(file);
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            file.write((const char*)meshes[i].vertices.data(), meshes[i].vertices.size() * sizeof(Vertex));
+            pad(file);
+            file.write((const char*)meshes[i].indices.data(), meshes[i].indices.size() * sizeof(unsigned int));
+            pad(file);
+        }
+        file.close();
+        if (!file)
+        {
+            std::cout << "ERROR::MESH_CACHE::CANNOT_WRITE " << target << std::endl;
+            std::remove(temporary.c_str());
+            return;
+        }
+        std::remove(target.c_str());
+        std::rename(temporary.c_str(), target.c_str());
+    }
+
+    void report() const
+    {
+        unsigned int models = this->hits + this->misses;
+        if (!this->enabled() || models == 0)
+            return;
+        std::cout << "mesh cache: " << this->hits.load() << " of " << models << " models loaded without importing them" << std::endl;
+    }
+
+private:
+    std::string directory;
+
+    MeshCache() : hits(0), misses(0) { }
+
+    // one file per model path, named after the model file to be found by hand
+    std::string path(const std::string &model) const
+    {
+        std::string name = model.substr(model.find_last_of('/') + 1);
+        char key[32];
+        snprintf(key, sizeof(key), "-%016llx.mesh", (unsigned long long)contentHash(model.data(), model.size()));
+        return this->directory + "/" + name + key;
+    }
+
+    // FNV-1a over 8 byte words, the sources run to megabytes
+    static uint64_t contentHash(const void *data, size_t size, uint64_t h = 14695981039346656037ULL)
+    {
+        const unsigned char *bytes = (const unsigned char*)data;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64_t word;
+            memcpy(&word, bytes + i, 8);
+            h = (h ^ word) * 1099511628211ULL;
+        }
+        for (; i < size; i++)
+            h = (h ^ bytes[i]) * 1099511628211ULL;
+        return h ? h : 1; // 0 is "no source"
+    }
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 15) & ~(uint64_t)15;
+    }
+
+    static void pad(std::ofstream &file)
+    {
+        static const char zeros[16] = { 0 };
+        uint64_t position = (uint64_t)file.tellp();
+        file.write(zeros, align(position) - position);
+    }
+};
+#endif
@@ -10,14 +10,19 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <learnopengl/gl_state.h>
 #include <learnopengl/mesh.h>
-#include <learnopengl/shader.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/shader_m.h>
+#include <learnopengl/texture_streamer.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
 #include <map>
+#include <memory>
 #include <vector>
 using namespace std;
 
@@ -29,6 +34,7 @@ public:
     /*  Model Data */
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh> meshes;
+    vector<unsigned int> drawOrder; // meshes sorted by material
     string directory;
     bool gammaCorrection;
 
@@ -36,21 +42,55 @@ public:
     // constructor, expects a filepath to a 3D model.
     Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
     {
-        loadModel(path);
+        if(import(path))
+            upload();
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader shader)
+    // an empty model, filled by import() and upload() (see ModelLoader)
+    Model() : gammaCorrection(false) { }
+
+    // the meshes own GL objects, a model is moved around (e.g. into a Scene) and never copied
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+    Model(Model&&) = default;
+    Model& operator=(Model&&) = default;
+
+    // draws the model, and thus all its meshes, binding each material once
+    void Draw(const Shader &shader) const
+    {
+        for(unsigned int i = 0; i < drawOrder.size(); i++)
+        {
+            const Mesh &mesh = meshes[drawOrder[i]];
+            if(i == 0 || mesh.material.id != meshes[drawOrder[i - 1]].material.id)
+                mesh.material.bind(shader);
+            mesh.DrawElements();
+        }
+    }
+
+    // draws the geometry only, for passes that sample no texture like the shadow map
+    void DrawElements() const
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].DrawElements();
     }
-    
-private:
-    /*  Functions   */
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+
+    // The half of loading that does not touch GL: maps the model's cache or imports it with
+    // Assimp (writing the cache), so it can run on any thread. False when it cannot be read.
+    bool import(string const &path)
     {
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        pending.reset(new Import());
+        MeshCache &cache = MeshCache::instance();
+        uint64_t sourceHash = cache.enabled() ? cache.sourceHash(path) : 0;
+        pending->fromCache = cache.open(path, sourceHash, pending->cached);
+        if(pending->fromCache)
+        {
+            // fault the pages in here, not in glBufferData on the context thread
+            pending->cached.prefetch();
+            return true;
+        }
         // read file via ASSIMP
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -58,13 +98,75 @@ private:
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            pending.reset();
+            return false;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
-
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+        cache.store(path, sourceHash, pending->meshes);
+        return true;
+    }
+
+    // The other half, on the thread of the GL context: creates the meshes' buffers from what
+    // import() left and loads their textures.
+    void upload()
+    {
+        if(!pending)
+            return;
+        if(pending->fromCache)
+            loadCached(pending->cached);
+        for(unsigned int i = 0; i < pending->meshes.size(); i++)
+        {
+            MeshData &data = pending->meshes[i];
+            vector<Texture> textures;
+            for(unsigned int t = 0; t < data.textures.size(); t++)
+                textures.push_back(loadMaterialTexture(data.textures[t].path, data.textures[t].type));
+            Mesh mesh(std::move(data.vertices), std::move(data.indices), textures);
+            mesh.material.id = data.materialIndex;
+            meshes.push_back(std::move(mesh));
+        }
+        pending.reset(); // unmaps the cache
+
+        // draw the meshes that share a material one after the other
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            drawOrder.push_back(i);
+        std::stable_sort(drawOrder.begin(), drawOrder.end(), [this](unsigned int a, unsigned int b) {
+            return meshes[a].material.id < meshes[b].material.id;
+        });
+    }
+
+    // deletes the meshes' buffers and the textures loaded for them
+    void deleteBuffers()
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].deleteBuffers();
+        for(unsigned int i = 0; i < textures_loaded.size(); i++)
+            glDeleteTextures(1, &textures_loaded[i].id);
+    }
+    
+private:
+    // what import() leaves for upload(): the mapped cache, or the meshes Assimp produced
+    struct Import {
+        MeshCacheFile cached;
+        bool fromCache;
+        vector<MeshData> meshes;
+    };
+    std::unique_ptr<Import> pending;
+
+    /*  Functions   */
+    // creates the meshes of a cache file, the GL buffers are filled straight from the mapping
+    void loadCached(const MeshCacheFile &cached)
+    {
+        for(unsigned int i = 0; i < cached.meshCount(); i++)
+        {
+            const MeshCacheRecord &record = cached.mesh(i);
+            vector<Texture> textures;
+            for(unsigned int t = record.firstTexture; t < record.firstTexture + record.textureCount; t++)
+                textures.push_back(loadMaterialTexture(cached.texturePath(t), cached.textureType(t)));
+            Mesh mesh(cached.vertices(record), record.vertexCount, cached.indices(record), record.indexCount, textures);
+            mesh.material.id = record.materialIndex;
+            meshes.push_back(std::move(mesh));
+        }
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -76,7 +178,7 @@ private:
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            pending->meshes.push_back(processMesh(mesh, scene));
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
@@ -86,7 +188,7 @@ private:
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    MeshData processMesh(aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
         vector<Vertex> vertices;
@@ -162,12 +264,17 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
         
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return the extracted mesh data, uploaded by upload()
+        MeshData result;
+        result.vertices = std::move(vertices);
+        result.indices = std::move(indices);
+        result.textures = std::move(textures);
+        result.materialIndex = mesh->mMaterialIndex;
+        return result;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
+    // lists all material textures of a given type, upload() loads the ones not loaded yet.
+    // the required info is returned as Texture structs without an id.
     vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
     {
         vector<Texture> textures;
@@ -175,69 +282,41 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            Texture texture;
+            texture.id = 0;
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            textures.push_back(texture);
         }
         return textures;
     }
+
+    // loads the texture at path (relative to the model) unless the model has loaded it already
+    Texture loadMaterialTexture(const string &path, const string &typeName)
+    {
+        // check if texture was loaded before and if so, skip loading a new texture
+        for(unsigned int j = 0; j < textures_loaded.size(); j++)
+        {
+            if(textures_loaded[j].path == path)
+                return textures_loaded[j]; // a texture with the same filepath has already been loaded (optimization)
+        }
+        // if texture hasn't been loaded already, load it
+        Texture texture;
+        texture.id = TextureFromFile(path.c_str(), this->directory);
+        texture.type = typeName;
+        texture.path = path;
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture;
+    }
 };
 
 
+// the texture holds a placeholder until TextureStreamer has decoded and uploaded the file
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
 
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureStreamer::instance().load2D(filename);
 }
 #endif
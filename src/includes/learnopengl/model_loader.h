@@ -0,0 +1,131 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include <learnopengl/model.h>
+#include <learnopengl/thread_pool.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Loads several models at once: Model::import() of each runs on a worker of the pool as soon
+// as it is added, and finish() uploads them on the calling thread, the one with the GL context,
+// in the order their imports complete. The models end up in the vector given to the constructor,
+// at the index add() returned. The pool is its own or one shared with other loading work (e.g.
+// the TextureStreamer), so that loading does not start more threads than there are cores.
+class ModelLoader
+{
+public:
+    // threads == 0 starts one worker per hardware thread besides the calling one
+    explicit ModelLoader(std::vector<Model> &models, unsigned int threads = 0)
+        : models(models), ownPool(new ThreadPool(threads)), pool(*ownPool), start(std::chrono::steady_clock::now()), elapsed(0.0) { }
+
+    // imports on a pool that outlives the loader
+    ModelLoader(std::vector<Model> &models, ThreadPool &pool)
+        : models(models), pool(pool), start(std::chrono::steady_clock::now()), elapsed(0.0) { }
+
+    // waits for the imports still running, they write to the loader; a shared pool may go on
+    // running other jobs
+    ~ModelLoader()
+    {
+        this->runQueued();
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->importDone.wait(lock, [this] { return this->completed.size() == this->loads.size(); });
+    }
+
+    // queues the import of the model at path and returns its index in the models vector
+    unsigned int add(const std::string &path, bool gamma = false)
+    {
+        unsigned int index = (unsigned int)this->loads.size();
+        Load *load = new Load();
+        load->path = path;
+        load->model.gammaCorrection = gamma;
+        this->loads.push_back(std::unique_ptr<Load>(load));
+        this->pool.submit([this, load, index] {
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            load->model.import(load->path);
+            load->importTime = std::chrono::steady_clock::now() - begin;
+            // notified under the lock: once it is released the loader may be gone
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->completed.push_back(index);
+            this->importDone.notify_all();
+        });
+        return (unsigned int)this->models.size() + index;
+    }
+
+    // Uploads every model as its import completes and moves them all into the models vector.
+    // Blocks until the last one is uploaded.
+    void finish()
+    {
+        this->runQueued();
+        for (unsigned int uploaded = 0; uploaded < this->loads.size(); uploaded++)
+        {
+            unsigned int index;
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->importDone.wait(lock, [this, uploaded] { return this->completed.size() > uploaded; });
+                index = this->completed[uploaded];
+            }
+            Load &load = *this->loads[index];
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            load.model.upload();
+            load.uploadTime = std::chrono::steady_clock::now() - begin;
+        }
+        this->elapsed = std::chrono::steady_clock::now() - this->start;
+        for (unsigned int i = 0; i < this->loads.size(); i++)
+            this->models.push_back(std::move(this->loads[i]->model));
+    }
+
+    // the time of each model on its worker and on the GL thread, then the wall clock time of all
+    void report() const
+    {
+        double serial = 0.0;
+        for (unsigned int i = 0; i < this->loads.size(); i++)
+        {
+            const Load &load = *this->loads[i];
+            std::string name = load.path.substr(load.path.find_last_of('/') + 1);
+            std::cout << "model " << name << ": imported in " << load.importTime.count() << " ms, uploaded in "
+                      << load.uploadTime.count() << " ms" << std::endl;
+            serial += load.importTime.count() + load.uploadTime.count();
+        }
+        std::cout << "models: " << this->loads.size() << " loaded in " << this->elapsed.count() << " ms on "
+                  << this->pool.size() << " workers (" << serial << " ms one after the other)" << std::endl;
+    }
+
+private:
+    typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+    // without workers nothing imports unless this thread does it
+    void runQueued()
+    {
+        if (this->pool.size() == 0)
+            while (this->pool.runOne()) { }
+    }
+
+    // a model while it loads, at a fixed address since the workers write to it
+    struct Load
+    {
+        std::string path;
+        Model model;
+        Milliseconds importTime, uploadTime;
+    };
+
+    std::vector<Model> &models;
+    std::vector<std::unique_ptr<Load> > loads;
+    std::unique_ptr<ThreadPool> ownPool; // NULL on a shared pool
+    ThreadPool &pool;
+    // indices of the loads whose import is done, in completion order
+    std::vector<unsigned int> completed;
+    std::mutex mutex;
+    std::condition_variable importDone;
+    std::chrono::steady_clock::time_point start;
+    Milliseconds elapsed;
+
+    ModelLoader(const ModelLoader&);
+    ModelLoader& operator=(const ModelLoader&);
+};
+#endif
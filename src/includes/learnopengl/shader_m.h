@@ -3,19 +3,486 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <learnopengl/gl_state.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <stdint.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// FNV-1a, extends h with size bytes of data
+inline uint64_t shaderHash(const void *data, size_t size, uint64_t h = 14695981039346656037ULL)
+{
+    const unsigned char *bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++)
+        h = (h ^ bytes[i]) * 1099511628211ULL;
+    return h;
+}
+
+// Location of a uniform resolved once, typed after the GLSL type it is set with so a handle
+// can only be passed to the matching Shader::set(). -1 (a uniform the linker optimized away)
+// is silently ignored by GL, like glGetUniformLocation's result.
+template <class T>
+struct Uniform
+{
+    GLint location;
+    Uniform() : location(-1) { }
+    explicit Uniform(GLint location) : location(location) { }
+    bool valid() const { return location >= 0; }
+};
+
+// Every active uniform of a linked program, enumerated once after linking. Names are looked
+// up by their FNV-1a hash in a sorted table, so the per-frame string setters neither allocate
+// nor query GL. Array elements are registered both as "name[i]" and, for the first one, "name".
+class ShaderUniforms
+{
+public:
+    explicit ShaderUniforms(GLuint program)
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(maxLength + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(program, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+            std::string name(buffer.data(), length);
+            // uniform block members have no location, they are set through their buffer
+            GLint location = glGetUniformLocation(program, name.c_str());
+            if (location < 0)
+                continue;
+            add(name, location);
+            // arrays are reported as "name[0]", register the plain name and every element
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                add(base, location);
+                for (GLint e = 1; e < size; e++)
+                {
+                    std::string element = base + "[" + std::to_string(e) + "]";
+                    add(element, glGetUniformLocation(program, element.c_str()));
+                }
+            }
+        }
+        std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.hash < b.hash; });
+    }
+
+    // -1 for names that are not active uniforms of the program
+    GLint find(const char *name) const
+    {
+        uint64_t key = hash(name);
+        std::vector<Entry>::const_iterator it = std::lower_bound(entries.begin(), entries.end(), key,
+            [](const Entry &entry, uint64_t key) { return entry.hash < key; });
+        for (; it != entries.end() && it->hash == key; ++it)
+        {
+            if (it->name == name)
+                return it->location;
+        }
+        return -1;
+    }
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t hash;
+        std::string name;
+        GLint location;
+    };
+    std::vector<Entry> entries;
+
+    void add(const std::string &name, GLint location)
+    {
+        Entry entry;
+        entry.hash = hash(name.c_str());
+        entry.name = name;
+        entry.location = location;
+        entries.push_back(entry);
+    }
+
+    static uint64_t hash(const char *name)
+    {
+        return shaderHash(name, strlen(name));
+    }
+};
+
+// Linked programs saved with glGetProgramBinary and loaded back with glProgramBinary on the
+// next launch, skipping the GLSL compile. A binary is keyed by a hash of the program's sources
+// and of the driver's vendor, renderer and version strings, so a driver update or an edited
+// shader simply misses. Drivers may still reject a binary (they are free to change their
+// format); the program is then compiled from source as if there were no cache. Off until
+// enable() is called, and stays off where the context has no program binary support.
+class ProgramBinaryCache
+{
+public:
+    unsigned int hits, misses, rejected;
+
+    static ProgramBinaryCache& instance()
+    {
+        static ProgramBinaryCache cache;
+        return cache;
+    }
+
+    // keeps the binaries in directory, created if missing; needs a current context
+    void enable(const std::string &directory)
+    {
+        GLint formats = 0;
+        if (glGetProgramBinary && glProgramBinary && glProgramParameteri)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        if (formats == 0)
+        {
+            std::cout << "WARNING::SHADER:: program binaries are not supported, compiling every shader" << std::endl;
+            return;
+        }
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+        this->directory = directory;
+        const char *strings[3] = { (const char*)glGetString(GL_VENDOR), (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION) };
+        this->driver = shaderHash(NULL, 0);
+        for (int i = 0; i < 3; i++)
+        {
+            if (strings[i])
+                this->driver = shaderHash(strings[i], strlen(strings[i]) + 1, this->driver);
+        }
+    }
+
+    bool enabled() const
+    {
+        return !this->directory.empty();
+    }
+
+    // key of a program built from the given sources (and anything else that changes the link)
+    uint64_t key(const std::vector<std::string> &sources) const
+    {
+        uint64_t h = this->driver;
+        for (unsigned int i = 0; i < sources.size(); i++)
+            h = shaderHash(sources[i].c_str(), sources[i].size() + 1, h);
+        return h;
+    }
+
+    // Creates program from its cached binary. False on a miss or when the driver rejects it.
+    bool load(uint64_t key, unsigned int &program)
+    {
+        if (!this->enabled())
+            return false;
+        std::ifstream file(this->path(key).c_str(), std::ios::binary | std::ios::ate);
+        std::streamoff size = file ? (std::streamoff)file.tellg() : 0;
+        file.seekg(0);
+        Header header;
+        std::vector<char> binary;
+        // the length comes from disk: a file that does not hold exactly that much is a miss
+        if (file.read((char*)&header, sizeof(header)) && memcmp(header.magic, "GLPB", 4) == 0 &&
+            (std::streamoff)header.length == size - (std::streamoff)sizeof(header))
+        {
+            binary.resize(header.length);
+            file.read(binary.data(), header.length);
+        }
+        if (binary.empty() || !file)
+        {
+            this->misses++;
+            return false;
+        }
+        program = glCreateProgram();
+        glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glDeleteProgram(program);
+            this->rejected++;
+            return false;
+        }
+        this->hits++;
+        return true;
+    }
+
+    // call between creating the program and linking it
+    void prepare(unsigned int program) const
+    {
+        if (this->enabled())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // saves the binary of a program linked from source
+    void store(uint64_t key, unsigned int program) const
+    {
+        GLint success = GL_FALSE, length = 0;
+        if (this->enabled())
+        {
+            glGetProgramiv(program, GL_LINK_STATUS, &success);
+            glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        }
+        if (!success || length <= 0)
+            return;
+        Header header;
+        memcpy(header.magic, "GLPB", 4);
+        std::vector<char> binary(length);
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &header.format, binary.data());
+        header.length = (uint32_t)written;
+        std::ofstream file(this->path(key).c_str(), std::ios::binary);
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), written);
+    }
+
+    void report() const
+    {
+        unsigned int programs = this->hits + this->misses + this->rejected;
+        if (!this->enabled() || programs == 0)
+            return;
+        std::cout << "program binary cache: " << this->hits << " of " << programs << " programs loaded ("
+                  << 100 * this->hits / programs << "% hit rate), " << this->rejected << " rejected by the driver" << std::endl;
+    }
+
+private:
+    struct Header
+    {
+        char magic[4];
+        GLenum format;
+        uint32_t length;
+    };
+    std::string directory;
+    uint64_t driver;
+
+    ProgramBinaryCache() : hits(0), misses(0), rejected(0), driver(0) { }
+
+    std::string path(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return this->directory + "/" + name;
+    }
+};
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// GL_KHR_parallel_shader_compile (or its ARB twin): the driver compiles and links on its own
+// threads and GL_COMPLETION_STATUS_KHR tells, without waiting, whether it is done. The glad
+// loader of this repo was generated without it, so its entry point is loaded here. Off until
+// enable() is called; without it programs still build, checking them just blocks.
+class ParallelShaderCompile
+{
+public:
+    static ParallelShaderCompile& instance()
+    {
+        static ParallelShaderCompile parallel;
+        return parallel;
+    }
+
+    // needs a current context, load is the loader glad was initialized with
+    bool enable(GLADloadproc load)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count && !this->supported; i++)
+        {
+            const char *name = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+            this->supported = name && (strcmp(name, "GL_KHR_parallel_shader_compile") == 0 || strcmp(name, "GL_ARB_parallel_shader_compile") == 0);
+        }
+        if (!this->supported)
+            return false;
+        typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+        MaxShaderCompilerThreadsProc maxThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsKHR");
+        if (!maxThreads)
+            maxThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsARB");
+        // 0xFFFFFFFF lets the driver pick; it may already be on without the call
+        if (maxThreads)
+            maxThreads(0xFFFFFFFFu);
+        return true;
+    }
+
+    bool enabled() const
+    {
+        return this->supported;
+    }
+
+private:
+    bool supported;
+
+    ParallelShaderCompile() : supported(false) { }
+};
+
+// A program shared by the copies of a Shader. Its compile and link may still be running in
+// the driver: the status, the program binary and the uniform table are only fetched by
+// finish(), which the first use() or uniform lookup calls, so that several programs can be
+// submitted before waiting on any of them.
+class ShaderProgram
+{
+public:
+    const GLuint ID;
+
+    // stages are the shaders still attached to a program linked from source, none for a
+    // program loaded from the binary cache
+    ShaderProgram(GLuint ID, uint64_t key, const std::vector<GLuint> &stages = std::vector<GLuint>())
+        : ID(ID), key(key), stages(stages) { }
+
+    // true once finish() would not block; always true without parallel compile
+    bool ready() const
+    {
+        if (this->table || !ParallelShaderCompile::instance().enabled())
+            return true;
+        GLint done = GL_FALSE;
+        glGetProgramiv(this->ID, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+
+    bool finished() const
+    {
+        return (bool)this->table;
+    }
+
+    // waits for the link, reports its errors and builds the uniform table, once
+    void finish()
+    {
+        if (this->table)
+            return;
+        if (!this->stages.empty())
+        {
+            for (unsigned int i = 0; i < this->stages.size(); i++)
+            {
+                GLint type = 0;
+                glGetShaderiv(this->stages[i], GL_SHADER_TYPE, &type);
+                checkCompileErrors(this->stages[i], type == GL_FRAGMENT_SHADER ? "FRAGMENT" : "VERTEX");
+            }
+            checkCompileErrors(this->ID, "PROGRAM");
+            ProgramBinaryCache::instance().store(this->key, this->ID);
+            // delete the shaders as they're linked into our program now and no longer necessery
+            for (unsigned int i = 0; i < this->stages.size(); i++)
+                glDeleteShader(this->stages[i]);
+            this->stages.clear();
+        }
+        this->table.reset(new ShaderUniforms(this->ID));
+    }
+
+    const ShaderUniforms& uniforms()
+    {
+        this->finish();
+        return *this->table;
+    }
+
+private:
+    uint64_t key;
+    std::vector<GLuint> stages;
+    std::unique_ptr<const ShaderUniforms> table;
+
+    // utility function for checking shader compilation/linking errors.
+    // ------------------------------------------------------------------------
+    static void checkCompileErrors(GLuint shader, std::string type)
+    {
+        GLint success;
+        GLchar infoLog[1024];
+        if (type != "PROGRAM")
+        {
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+            if (!success)
+            {
+                glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+            }
+        }
+        else
+        {
+            glGetProgramiv(shader, GL_LINK_STATUS, &success);
+            if (!success)
+            {
+                glGetProgramInfoLog(shader, 1024, NULL, infoLog);
+                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+            }
+        }
+    }
+};
+
+// Compile-time feature keys of a shader variant, emitted as "#define NAME value" lines right
+// after the #version line of every stage. The sources can then test them with #if and fall
+// back to their own defaults with #ifndef. Kept sorted, so the same set always produces the
+// same preamble, and with it the same program binary cache key.
+class ShaderDefines
+{
+public:
+    ShaderDefines& set(const std::string &name, int value)
+    {
+        values[name] = value;
+        return *this;
+    }
+
+    bool empty() const
+    {
+        return values.empty();
+    }
+
+    std::string preamble() const
+    {
+        std::string lines;
+        for (std::map<std::string, int>::const_iterator it = values.begin(); it != values.end(); ++it)
+            lines += "#define " + it->first + " " + std::to_string(it->second) + "\n";
+        return lines;
+    }
+
+    // inserts the preamble after the #version line, keeping the line numbers of the errors
+    std::string specialize(const std::string &code) const
+    {
+        if (values.empty())
+            return code;
+        size_t version = code.find("#version");
+        if (version == std::string::npos)
+            return preamble() + "#line 1\n" + code;
+        size_t end = code.find('\n', version);
+        if (end == std::string::npos)
+            return code + "\n" + preamble();
+        int line = (int)std::count(code.begin(), code.begin() + end, '\n') + 2;
+        return code.substr(0, end + 1) + preamble() + "#line " + std::to_string(line) + "\n" + code.substr(end + 1);
+    }
+
+private:
+    std::map<std::string, int> values;
+};
+
+// SHADER_LINK_DEFERRED submits the compile and link and returns; the program is finished on
+// first use, or earlier by ShaderBatch
+enum ShaderLink {
+    SHADER_LINK_NOW,
+    SHADER_LINK_DEFERRED
+};
 
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // shared by the copies of this shader, which are passed around by value
+    std::shared_ptr<ShaderProgram> program;
+    // an empty shader, for objects that are never drawn
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath)
+    Shader() : ID(0) { }
+    // constructor generates the shader on the fly, specialized with the given defines
+    // ------------------------------------------------------------------------
+    Shader(const char* vertexPath, const char* fragmentPath, const ShaderDefines &defines = ShaderDefines(), ShaderLink link = SHADER_LINK_NOW)
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -38,128 +505,333 @@ public:
             vShaderFile.close();
             fShaderFile.close();
             // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
+            vertexCode = defines.specialize(vShaderStream.str());
+            fragmentCode = defines.specialize(fShaderStream.str());
         }
-        catch (std::ifstream::failure e)
+        catch (const std::ifstream::failure &e)
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        // 2. load the linked program from the binary cache when it has it
+        ProgramBinaryCache &cache = ProgramBinaryCache::instance();
+        std::vector<std::string> sources;
+        sources.push_back(vertexCode);
+        sources.push_back(fragmentCode);
+        uint64_t key = cache.key(sources);
+        if (cache.load(key, ID))
+        {
+            program = std::make_shared<ShaderProgram>(ID, key);
+            program->finish();
+            return;
+        }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
+        // 3. compile shaders, their status is checked once the program is finished
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex, 1, &vShaderCode, NULL);
         glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
         // fragment Shader
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
         glShaderSource(fragment, 1, &fShaderCode, NULL);
         glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
         // shader Program
         ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
+        cache.prepare(ID);
         glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-
+        std::vector<GLuint> stages;
+        stages.push_back(vertex);
+        stages.push_back(fragment);
+        program = std::make_shared<ShaderProgram>(ID, key, stages);
+        if (link == SHADER_LINK_NOW)
+            program->finish();
+    }
+    // constructor for a vertex-only program whose outputs are captured with transform feedback
+    // (interleaved, in the order given) instead of being rasterized
+    // ------------------------------------------------------------------------
+    Shader(const char* vertexPath, const std::vector<std::string> &feedbackVaryings)
+    {
+        std::string vertexCode;
+        std::ifstream vShaderFile;
+        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+        try 
+        {
+            vShaderFile.open(vertexPath);
+            std::stringstream vShaderStream;
+            vShaderStream << vShaderFile.rdbuf();
+            vShaderFile.close();
+            vertexCode = vShaderStream.str();
+        }
+        catch (const std::ifstream::failure &e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+        }
+        // the varyings are part of the link, so of the key
+        ProgramBinaryCache &cache = ProgramBinaryCache::instance();
+        std::vector<std::string> sources(1, vertexCode);
+        sources.insert(sources.end(), feedbackVaryings.begin(), feedbackVaryings.end());
+        uint64_t key = cache.key(sources);
+        if (cache.load(key, ID))
+        {
+            program = std::make_shared<ShaderProgram>(ID, key);
+            program->finish();
+            return;
+        }
+        const char* vShaderCode = vertexCode.c_str();
+        unsigned int vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        ID = glCreateProgram();
+        glAttachShader(ID, vertex);
+        // the varyings have to be declared before linking
+        std::vector<const char*> varyings;
+        for (unsigned int i = 0; i < feedbackVaryings.size(); i++)
+            varyings.push_back(feedbackVaryings[i].c_str());
+        glTransformFeedbackVaryings(ID, (GLsizei)varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+        cache.prepare(ID);
+        glLinkProgram(ID);
+        program = std::make_shared<ShaderProgram>(ID, key, std::vector<GLuint>(1, vertex));
+        program->finish();
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() const
     { 
-        glUseProgram(ID); 
+        program->finish();
+        glState().useProgram(ID); 
+    }
+    // true once the program can be used without waiting for the driver to link it
+    // ------------------------------------------------------------------------
+    bool ready() const
+    {
+        return program->ready();
+    }
+    // location of an active uniform from the table built at link time, -1 if there is none
+    // ------------------------------------------------------------------------
+    GLint location(const char *name) const
+    {
+        return program->uniforms().find(name);
+    }
+    GLint location(const std::string &name) const
+    {
+        return program->uniforms().find(name.c_str());
+    }
+    // typed handle to set a uniform without any lookup, resolve it once and keep it
+    // ------------------------------------------------------------------------
+    template <class T>
+    Uniform<T> uniform(const char *name) const
+    {
+        return Uniform<T>(location(name));
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
+    void set(Uniform<bool> uniform, bool value) const { glUniform1i(uniform.location, (int)value); }
+    void set(Uniform<int> uniform, int value) const { glUniform1i(uniform.location, value); }
+    void set(Uniform<unsigned int> uniform, unsigned int value) const { glUniform1ui(uniform.location, value); }
+    void set(Uniform<float> uniform, float value) const { glUniform1f(uniform.location, value); }
+    void set(Uniform<glm::vec2> uniform, const glm::vec2 &value) const { glUniform2fv(uniform.location, 1, &value[0]); }
+    void set(Uniform<glm::vec3> uniform, const glm::vec3 &value) const { glUniform3fv(uniform.location, 1, &value[0]); }
+    void set(Uniform<glm::vec4> uniform, const glm::vec4 &value) const { glUniform4fv(uniform.location, 1, &value[0]); }
+    void set(Uniform<glm::mat2> uniform, const glm::mat2 &mat) const { glUniformMatrix2fv(uniform.location, 1, GL_FALSE, &mat[0][0]); }
+    void set(Uniform<glm::mat3> uniform, const glm::mat3 &mat) const { glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &mat[0][0]); }
+    void set(Uniform<glm::mat4> uniform, const glm::mat4 &mat) const { glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]); }
+    // by name, looked up in the uniform table; string literals take the const char* overloads
+    // and never build a std::string
+    // ------------------------------------------------------------------------
+    void setBool(const char *name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(location(name), (int)value); 
     }
+    void setBool(const std::string &name, bool value) const { setBool(name.c_str(), value); }
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
+    void setInt(const char *name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(location(name), value); 
     }
+    void setInt(const std::string &name, int value) const { setInt(name.c_str(), value); }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
+    void setUint(const char *name, unsigned int value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1ui(location(name), value); 
     }
+    void setUint(const std::string &name, unsigned int value) const { setUint(name.c_str(), value); }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string &name, const glm::vec2 &value) const
+    void setFloat(const char *name, float value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform1f(location(name), value); 
     }
-    void setVec2(const std::string &name, float x, float y) const
+    void setFloat(const std::string &name, float value) const { setFloat(name.c_str(), value); }
+    // ------------------------------------------------------------------------
+    void setVec2(const char *name, const glm::vec2 &value) const
+    { 
+        glUniform2fv(location(name), 1, &value[0]); 
+    }
+    void setVec2(const char *name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(location(name), x, y); 
     }
+    void setVec2(const std::string &name, const glm::vec2 &value) const { setVec2(name.c_str(), value); }
+    void setVec2(const std::string &name, float x, float y) const { setVec2(name.c_str(), x, y); }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string &name, const glm::vec3 &value) const
+    void setVec3(const char *name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(location(name), 1, &value[0]); 
     }
-    void setVec3(const std::string &name, float x, float y, float z) const
+    void setVec3(const char *name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(location(name), x, y, z); 
     }
+    void setVec3(const std::string &name, const glm::vec3 &value) const { setVec3(name.c_str(), value); }
+    void setVec3(const std::string &name, float x, float y, float z) const { setVec3(name.c_str(), x, y, z); }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string &name, const glm::vec4 &value) const
+    void setVec4(const char *name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(location(name), 1, &value[0]); 
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) const
+    void setVec4(const char *name, float x, float y, float z, float w) const
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(location(name), x, y, z, w); 
     }
+    void setVec4(const std::string &name, const glm::vec4 &value) const { setVec4(name.c_str(), value); }
+    void setVec4(const std::string &name, float x, float y, float z, float w) const { setVec4(name.c_str(), x, y, z, w); }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+    void setMat2(const char *name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
+    void setMat2(const std::string &name, const glm::mat2 &mat) const { setMat2(name.c_str(), mat); }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
+    void setMat3(const char *name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
+    void setMat3(const std::string &name, const glm::mat3 &mat) const { setMat3(name.c_str(), mat); }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    void setMat4(const char *name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
+    void setMat4(const std::string &name, const glm::mat4 &mat) const { setMat4(name.c_str(), mat); }
+};
 
-private:
-    // utility function for checking shader compilation/linking errors.
-    // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+// Programs submitted together so the driver can compile them side by side, with parallel
+// shader compile on its own threads. Nothing is queried while they are added: finish() waits
+// for all of them, poll() finishes the ones the driver is done with and never blocks when
+// parallel compile is on, so the render loop can start while the programs it does not need
+// yet are still compiling (check those with Shader::ready() before drawing with them).
+class ShaderBatch
+{
+public:
+    // SHADER_LINK_NOW links every program as it is added, to compare against; name prefixes
+    // the reports
+    explicit ShaderBatch(ShaderLink link = SHADER_LINK_DEFERRED, const char *name = "shaders")
+        : link(link), name(name), start(std::chrono::steady_clock::now()), waiting(false) { }
+
+    Shader add(const char* vertexPath, const char* fragmentPath, const ShaderDefines &defines = ShaderDefines())
     {
-        GLint success;
-        GLchar infoLog[1024];
-        if (type != "PROGRAM")
+        Shader shader(vertexPath, fragmentPath, defines, link);
+        programs.push_back(shader.program);
+        waiting = true;
+        return shader;
+    }
+
+    // waits for every program of the batch
+    void finish()
+    {
+        for (unsigned int i = 0; i < programs.size(); i++)
+            programs[i]->finish();
+        complete();
+    }
+
+    // True on the call that finishes the last program of the batch. Cheap once it has.
+    bool poll()
+    {
+        if (!waiting)
+            return false;
+        for (unsigned int i = 0; i < programs.size(); i++)
         {
-            glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-            if (!success)
-            {
-                glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
-            }
+            if (!programs[i]->finished() && programs[i]->ready())
+                programs[i]->finish();
         }
-        else
+        return complete();
+    }
+
+    // milliseconds since the batch was created
+    double elapsed() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void report(const char *stage) const
+    {
+        unsigned int finished = 0;
+        for (unsigned int i = 0; i < programs.size(); i++)
+            finished += programs[i]->finished() ? 1 : 0;
+        std::cout << name << ": " << stage << " after " << elapsed() << " ms, " << finished << " of "
+                  << programs.size() << " programs linked" << (ParallelShaderCompile::instance().enabled() ? " (parallel compile)" : "") << std::endl;
+    }
+
+private:
+    ShaderLink link;
+    std::string name;
+    std::chrono::steady_clock::time_point start;
+    std::vector<std::shared_ptr<ShaderProgram> > programs;
+    bool waiting; // programs were added since the batch last completed
+
+    bool complete()
+    {
+        if (!waiting)
+            return false;
+        for (unsigned int i = 0; i < programs.size(); i++)
         {
-            glGetProgramiv(shader, GL_LINK_STATUS, &success);
-            if (!success)
-            {
-                glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
-            }
+            if (!programs[i]->finished())
+                return false;
         }
+        waiting = false;
+        report("all programs linked");
+        return true;
+    }
+};
+
+// The specialized programs of one vertex/fragment pair, built on demand the first time a set
+// of defines is asked for and reused afterwards. With a batch, new programs are added to it
+// and compile with the rest; without one they are linked before get() returns. onBuild runs
+// once on every new program, e.g. to attach its uniform blocks; anything it asks GL about the
+// program waits for its link. Look the variants up while setting up and keep the Shader
+// copies: get() formats the defines into a key on every call.
+class ShaderVariants
+{
+public:
+    std::function<void(const Shader&)> onBuild;
+
+    ShaderVariants(const char* vertexPath, const char* fragmentPath, ShaderBatch *batch = NULL)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), batch(batch) { }
+
+    const Shader& get(const ShaderDefines &defines)
+    {
+        std::string key = defines.preamble();
+        std::map<std::string, Shader>::iterator it = variants.find(key);
+        if (it != variants.end())
+            return it->second;
+        Shader shader = batch ? batch->add(vertexPath.c_str(), fragmentPath.c_str(), defines)
+                              : Shader(vertexPath.c_str(), fragmentPath.c_str(), defines);
+        it = variants.insert(std::make_pair(key, shader)).first;
+        if (onBuild)
+            onBuild(it->second);
+        return it->second;
+    }
+
+    size_t size() const
+    {
+        return variants.size();
     }
+
+private:
+    std::string vertexPath, fragmentPath;
+    ShaderBatch *batch;
+    std::map<std::string, Shader> variants;
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,352 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <learnopengl/gl_state.h>
+#include <learnopengl/thread_pool.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Loads image files into textures without stalling the GL thread. A load returns the texture
+// at once, holding a 1x1 placeholder; a worker decodes the file, update() maps a pixel unpack
+// buffer for it, a worker copies the pixels into the mapping, and a later update() unmaps it
+// and respecifies the texture from the buffer, so the copy to the GPU runs asynchronously.
+// The texture name never changes, so materials resolved against the placeholder pick up the
+// real image by themselves.
+//
+// Off until enable() is called: every load then decodes and uploads before returning.
+class TextureStreamer
+{
+public:
+    static TextureStreamer& instance()
+    {
+        static TextureStreamer streamer;
+        return streamer;
+    }
+
+    // decodes on threads workers (0: one per hardware thread besides this one) and uploads at
+    // most bytesPerFrame of pixels per update(); needs a current context
+    void enable(unsigned int threads = 0, size_t bytesPerFrame = 16 << 20)
+    {
+        this->ownPool.reset(new ThreadPool(threads));
+        this->pool = this->ownPool.get();
+        this->bytesPerFrame = bytesPerFrame;
+    }
+
+    // decodes on a pool shared with other loading work, it has to outlive disable()
+    void enable(ThreadPool &pool, size_t bytesPerFrame = 16 << 20)
+    {
+        this->ownPool.reset();
+        this->pool = &pool;
+        this->bytesPerFrame = bytesPerFrame;
+    }
+
+    bool enabled() const
+    {
+        return this->pool != NULL;
+    }
+
+    // Lands every pending texture, then joins the workers and deletes the buffers. Call before
+    // the context goes away; later loads are synchronous again.
+    void disable()
+    {
+        if (!this->enabled())
+            return;
+        while (!this->requests.empty())
+        {
+            this->pool->wait();
+            this->update(0);
+        }
+        this->pool = NULL;
+        this->ownPool.reset();
+        if (!this->buffers.empty())
+            glDeleteBuffers((GLsizei)this->buffers.size(), this->buffers.data());
+        this->buffers.clear();
+    }
+
+    // a mipmapped 2D texture; clampTransparent clamps images with an alpha channel to their
+    // edges instead of repeating them
+    GLuint load2D(const std::string &path, bool clampTransparent = false)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glState().bindTexture(GL_TEXTURE_2D, texture);
+        if (this->enabled())
+            this->placeholder(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        this->request(path, texture, GL_TEXTURE_2D, GL_TEXTURE_2D, clampTransparent);
+        return texture;
+    }
+
+    // a cubemap from its +X, -X, +Y, -Y, +Z and -Z faces, each face lands on its own
+    GLuint loadCubemap(const std::vector<std::string> &faces)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glState().bindTexture(GL_TEXTURE_CUBE_MAP, texture);
+        for (unsigned int i = 0; this->enabled() && i < faces.size(); i++)
+            this->placeholder(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        for (unsigned int i = 0; i < faces.size(); i++)
+            this->request(faces[i], texture, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, false);
+        glState().bindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        return texture;
+    }
+
+    // Call once a frame on the GL thread: maps buffers for the decoded images and uploads the
+    // copied ones, never waiting on a worker. Returns true on the call that lands the last
+    // pending image.
+    bool update()
+    {
+        return this->update(this->bytesPerFrame);
+    }
+
+    unsigned int pending() const
+    {
+        return (unsigned int)this->requests.size();
+    }
+
+    void report() const
+    {
+        if (this->images == 0)
+            return;
+        if (!this->enabled())
+        {
+            std::cout << "textures: " << this->images << " images (" << this->bytes / (1 << 20) << " MB) loaded in "
+                      << this->elapsed.count() << " ms on the GL thread" << std::endl;
+            return;
+        }
+        std::cout << "textures: " << this->images << " images (" << this->bytes / (1 << 20) << " MB) decoded in "
+                  << this->decodeTime.count() << " ms on the workers, streamed in " << this->elapsed.count()
+                  << " ms, placeholders drawn for " << this->frames << " frames" << std::endl;
+    }
+
+private:
+    typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+    enum Stage { DECODING, DECODED, COPYING, COPIED };
+
+    // one image on its way to a texture; written by one worker at a time, handed over through stage
+    struct Request
+    {
+        std::string path;
+        GLuint texture;
+        GLenum target, face;
+        bool clampTransparent;
+        std::atomic<int> stage;
+        unsigned char *pixels;
+        int width, height, components;
+        Milliseconds decodeTime;
+        GLuint buffer;
+        void *mapping;
+    };
+
+    std::unique_ptr<ThreadPool> ownPool; // NULL on a shared pool
+    ThreadPool *pool;
+    std::vector<std::unique_ptr<Request> > requests;
+    std::vector<GLuint> buffers; // unpack buffers not in use, orphaned before they are mapped again
+    size_t bytesPerFrame;
+    // statistics
+    unsigned int images, frames;
+    size_t bytes;
+    Milliseconds decodeTime, elapsed;
+    std::chrono::steady_clock::time_point start;
+
+    TextureStreamer() : pool(NULL), bytesPerFrame(0), images(0), frames(0), bytes(0), decodeTime(0.0), elapsed(0.0) { }
+
+    TextureStreamer(const TextureStreamer&);
+    TextureStreamer& operator=(const TextureStreamer&);
+
+    void placeholder(GLenum face) const
+    {
+        static const unsigned char grey[4] = { 128, 128, 128, 255 };
+        glTexImage2D(face, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    }
+
+    void request(const std::string &path, GLuint texture, GLenum target, GLenum face, bool clampTransparent)
+    {
+        Request *request = new Request();
+        request->path = path;
+        request->texture = texture;
+        request->target = target;
+        request->face = face;
+        request->clampTransparent = clampTransparent;
+        request->stage = DECODING;
+        request->buffer = 0;
+        request->mapping = NULL;
+        if (!this->enabled())
+        {
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            decode(*request);
+            if (request->pixels)
+                this->upload(*request, request->pixels);
+            finish(*request);
+            delete request;
+            this->elapsed += std::chrono::steady_clock::now() - begin;
+            return;
+        }
+        if (this->requests.empty())
+        {
+            this->start = std::chrono::steady_clock::now();
+            this->frames = 0;
+        }
+        this->requests.push_back(std::unique_ptr<Request>(request));
+        this->pool->submit([request] {
+            decode(*request);
+            request->stage.store(DECODED, std::memory_order_release);
+        });
+    }
+
+    bool update(size_t budget)
+    {
+        if (this->requests.empty())
+            return false;
+        this->frames++;
+        // a pool without workers (a single core) runs one queued decode or copy a frame here
+        if (this->pool->size() == 0)
+            this->pool->runOne();
+        size_t streamed = 0;
+        for (unsigned int i = 0; i < this->requests.size(); )
+        {
+            Request &request = *this->requests[i];
+            int stage = request.stage.load(std::memory_order_acquire);
+            if (stage == DECODED && (budget == 0 || streamed < budget))
+            {
+                if (!request.pixels)
+                {
+                    finish(request);
+                    this->requests.erase(this->requests.begin() + i);
+                    continue;
+                }
+                streamed += this->map(request);
+            }
+            else if (stage == COPIED)
+            {
+                this->unmap(request);
+                finish(request);
+                this->requests.erase(this->requests.begin() + i);
+                continue;
+            }
+            i++;
+        }
+        if (!this->requests.empty())
+            return false;
+        this->elapsed = std::chrono::steady_clock::now() - this->start;
+        return true;
+    }
+
+    static void decode(Request &request)
+    {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        request.pixels = stbi_load(request.path.c_str(), &request.width, &request.height, &request.components, 0);
+        request.decodeTime = std::chrono::steady_clock::now() - begin;
+    }
+
+    static size_t size(const Request &request)
+    {
+        return (size_t)request.width * request.height * request.components;
+    }
+
+    // orphans a buffer, maps it and has a worker copy the pixels into the mapping
+    size_t map(Request &request)
+    {
+        if (this->buffers.empty())
+        {
+            GLuint buffer;
+            glGenBuffers(1, &buffer);
+            this->buffers.push_back(buffer);
+        }
+        request.buffer = this->buffers.back();
+        this->buffers.pop_back();
+        size_t bytes = size(request);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, request.buffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+        request.mapping = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (!request.mapping)
+        {
+            // no mapping, upload straight from the decoded pixels instead
+            this->upload(request, request.pixels);
+            this->buffers.push_back(request.buffer);
+            request.buffer = 0;
+            request.stage = COPIED;
+            return bytes;
+        }
+        request.stage = COPYING;
+        Request *copy = &request;
+        this->pool->submit([copy] {
+            memcpy(copy->mapping, copy->pixels, size(*copy));
+            copy->stage.store(COPIED, std::memory_order_release);
+        });
+        return bytes;
+    }
+
+    // unmaps the copied pixels and respecifies the texture from the buffer
+    void unmap(Request &request)
+    {
+        if (!request.buffer)
+            return; // uploaded by map()
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, request.buffer);
+        if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE)
+            this->upload(request, (const void*)0);
+        else
+            std::cout << "Texture lost its pixels while mapped: " << request.path << std::endl;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        this->buffers.push_back(request.buffer);
+    }
+
+    // pixels is an offset into the bound unpack buffer, or client memory when none is bound
+    void upload(const Request &request, const void *pixels)
+    {
+        GLenum format = GL_RGBA;
+        if (request.components == 1)
+            format = GL_RED;
+        else if (request.components == 2)
+            format = GL_RG;
+        else if (request.components == 3)
+            format = GL_RGB;
+
+        glState().bindTexture(request.target, request.texture);
+        // rows are tightly packed, an RGB image of odd width is not 4-byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(request.face, 0, request.target == GL_TEXTURE_CUBE_MAP ? GL_RGB : format, request.width, request.height, 0, format, GL_UNSIGNED_BYTE, pixels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        this->images++;
+        this->bytes += size(request);
+        this->decodeTime += request.decodeTime;
+        if (request.target != GL_TEXTURE_2D)
+            return;
+        glGenerateMipmap(GL_TEXTURE_2D);
+        GLint wrap = request.clampTransparent && format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    // frees the decoded pixels, or reports the file that could not be decoded
+    void finish(Request &request)
+    {
+        if (!request.pixels)
+        {
+            std::cout << (request.target == GL_TEXTURE_CUBE_MAP ? "Cubemap texture" : "Texture") << " failed to load at path: " << request.path << std::endl;
+            return;
+        }
+        stbi_image_free(request.pixels);
+        request.pixels = NULL;
+    }
+};
+#endif
@@ -0,0 +1,132 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// thread count of a pool without workers, whose jobs all run in wait() or runOne()
+const unsigned int THREAD_POOL_NO_WORKERS = 0xFFFFFFFFu;
+
+// A fixed set of worker threads pulling jobs from a shared queue. Jobs may queue more jobs;
+// wait() returns once the queue is drained and every running job has finished, and the
+// calling thread works on the queue meanwhile, so a pool without workers still makes progress.
+class ThreadPool
+{
+public:
+    // threads == 0 picks one worker per hardware thread besides the calling one
+    explicit ThreadPool(unsigned int threads = 0) : next(0), pending(0), stopping(false)
+    {
+        if (threads == THREAD_POOL_NO_WORKERS)
+            threads = 0;
+        else if (threads == 0)
+        {
+            unsigned int hardware = std::thread::hardware_concurrency();
+            threads = hardware > 1 ? hardware - 1 : 0;
+        }
+        for (unsigned int i = 0; i < threads; i++)
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobAvailable.notify_all();
+        for (unsigned int i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    unsigned int size() const
+    {
+        return (unsigned int)workers.size();
+    }
+
+    // queues a job and returns immediately
+    // ------------------------------------------------------------------------
+    void submit(const std::function<void()> &job)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobs.push_back(job);
+            pending++;
+        }
+        jobAvailable.notify_one();
+    }
+
+    // blocks until every job submitted so far (and the jobs they submitted) has run
+    // ------------------------------------------------------------------------
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (pending > 0)
+        {
+            if (next < jobs.size())
+            {
+                runOne(lock);
+                continue;
+            }
+            allDone.wait(lock);
+        }
+    }
+
+    // runs one queued job on the calling thread, false when none is queued; lets a pool
+    // without workers make progress without waiting for all of its jobs
+    // ------------------------------------------------------------------------
+    bool runOne()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (next == jobs.size())
+            return false;
+        runOne(lock);
+        return true;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    // the queue is jobs[next..], emptied once drained so its storage is reused frame after frame
+    std::vector<std::function<void()> > jobs;
+    size_t next;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable allDone;
+    unsigned int pending;
+    bool stopping;
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void workerLoop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            jobAvailable.wait(lock, [this] { return stopping || next < jobs.size(); });
+            if (next == jobs.size())
+                return;
+            runOne(lock);
+        }
+    }
+
+    // pops the next job and runs it with the lock released
+    void runOne(std::unique_lock<std::mutex> &lock)
+    {
+        std::function<void()> job;
+        job.swap(jobs[next++]);
+        if (next == jobs.size())
+        {
+            jobs.clear();
+            next = 0;
+        }
+        lock.unlock();
+        job();
+        lock.lock();
+        if (--pending == 0)
+            allDone.notify_all();
+    }
+};
+#endif
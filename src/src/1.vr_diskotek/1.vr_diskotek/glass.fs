@@ -1,16 +1,36 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out float OITWeight;
 
 in vec3 Normal;
 in vec3 Position;
 
-uniform vec3 cameraPos;
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
 uniform samplerCube skybox;
+uniform bool weightedOIT;
+
+// depth weight of weighted blended OIT (McGuire & Bavoil 2013, eq. 10)
+float oitWeight(float alpha)
+{
+    float distance = 1.0 - gl_FragCoord.z;
+    return alpha * clamp(3e3 * distance * distance * distance, 1e-2, 3e3);
+}
 
 void main()
 {             
     float ratio = 1.00/1.33;
-    vec3 I = normalize(Position - cameraPos);
+    vec3 I = normalize(Position - viewPos);
     vec3 R = refract(I, normalize(Normal), ratio);
-    FragColor = vec4(texture(skybox, R).rgb, 0.1);
+    vec4 color = vec4(texture(skybox, R).rgb, 0.1);
+    if (weightedOIT) {
+        float weight = oitWeight(color.a);
+        FragColor = vec4(color.rgb * weight, color.a);
+        OITWeight = weight;
+    } else {
+        FragColor = color;
+    }
 }
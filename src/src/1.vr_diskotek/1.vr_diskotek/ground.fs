@@ -12,7 +12,11 @@ uniform sampler2D diffuseTexture;
 uniform sampler2D shadowMap;
 
 uniform vec3 lightPos;
-uniform vec3 viewPos;
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
 
 float ShadowCalculation(vec4 fragPosLightSpace)
 {
@@ -12,10 +12,16 @@ out VS_OUT {
     vec4 FragPosLightSpace;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+layout (std140) uniform Shadow {
+    mat4 lightSpaceMatrix;
+};
+
 uniform mat4 model;
-uniform mat4 lightSpaceMatrix;
 
 void main()
 {
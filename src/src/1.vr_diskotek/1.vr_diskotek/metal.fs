@@ -4,7 +4,11 @@ out vec4 FragColor;
 in vec3 Normal;
 in vec3 Position;
 
-uniform vec3 cameraPos;
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
 uniform samplerCube skybox;
 
 uniform sampler2D texture_diffuse1;
@@ -12,7 +16,7 @@ uniform sampler2D texture_specular1;
 
 void main()
 {             
-    vec3 I = normalize(Position - cameraPos);
+    vec3 I = normalize(Position - viewPos);
     vec3 R = reflect(I, normalize(Normal));
     FragColor = vec4(texture(skybox, R).rgb, 1.0);
 }
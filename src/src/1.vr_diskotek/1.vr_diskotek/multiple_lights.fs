@@ -15,56 +15,69 @@ struct DirLight {
     vec3 specular;
 };
 
+// members ordered so every float fills the slot after a vec3 (std140)
 struct PointLight {
     vec3 position;
-    
     float constant;
-    float linear;
-    float quadratic;
-	
     vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-  
-    float constant;
     float linear;
-    float quadratic;
-  
-    vec3 ambient;
     vec3 diffuse;
-    vec3 specular;       
+    float quadratic;
+    vec3 specular;
 };
 
-#define NR_POINT_LIGHTS 4
+// variant keys, see ShaderVariants; the defaults give the full quality program
+#ifndef NR_POINT_LIGHTS
+#define NR_POINT_LIGHTS 4 // lit point lights, at most MAX_POINT_LIGHTS
+#endif
+#ifndef SHADOWS
+#define SHADOWS 1 // the first point light casts the shadow map
+#endif
+#ifndef PCF_RADIUS
+#define PCF_RADIUS 1 // shadow map taps: (2 * PCF_RADIUS + 1)^2
+#endif
+#ifndef SPECULAR
+#define SPECULAR 1 // specular highlights
+#endif
+
+// size of the Lights block, the same for every variant (SCENE_POINT_LIGHTS)
+#define MAX_POINT_LIGHTS 4
+#if NR_POINT_LIGHTS > MAX_POINT_LIGHTS
+#error NR_POINT_LIGHTS is larger than the Lights block
+#endif
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+#if SHADOWS
 in vec4 FragPosLightSpace;
+#endif
 
-uniform vec3 viewPos;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
+// shared blocks, see scene_uniforms.h
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+layout (std140) uniform Lights {
+    DirLight dirLight;
+    PointLight pointLights[MAX_POINT_LIGHTS];
+};
 uniform Material material;
 
 uniform sampler2D texture_diffuse1;
 uniform sampler2D texture_specular1;
+#if SHADOWS
 uniform sampler2D shadowMap;
+#endif
 
 // function prototypes
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 CalcPointLightShadow(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow);
+vec3 Specular(vec3 lightSpecular, vec3 lightDir, vec3 normal, vec3 viewDir);
+#if SHADOWS
 float ShadowCalculation(vec4 fragPosLightSpace, vec3 lightPos);
+#endif
 
 void main()
 {    
@@ -73,25 +86,25 @@ void main()
     vec3 viewDir = normalize(viewPos - FragPos);
     
     // == =====================================================
-    // Our lighting is set up in 3 phases: directional, point lights and an optional flashlight
+    // Our lighting is set up in 2 phases: directional and point lights
     // For each phase, a calculate function is defined that calculates the corresponding color
     // per lamp. In the main() function we take all the calculated colors and sum them up for
     // this fragment's final color.
     // == =====================================================
     // phase 1: directional lighting
     vec3 result = CalcDirLight(dirLight, norm, viewDir);
-    // phase 2: point lights
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        if(i == 0) {
-            result += CalcPointLightShadow(pointLights[i], norm, FragPos, viewDir); 
-        } 
-        else {
-            result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
-        }
-        
-    // phase 3: spot light
-    // result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
-    
+    // phase 2: point lights, the first one casts the shadows
+#if NR_POINT_LIGHTS > 0
+#if SHADOWS
+    float shadow = ShadowCalculation(FragPosLightSpace, pointLights[0].position);
+#else
+    float shadow = 0.0;
+#endif
+    result += CalcPointLight(pointLights[0], norm, FragPos, viewDir, shadow);
+#endif
+    for(int i = 1; i < NR_POINT_LIGHTS; i++)
+        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir, 0.0);
+
     FragColor = vec4(result, 1.0);
 }
 
@@ -101,88 +114,45 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // combine results
     vec3 ambient = light.ambient * vec3(texture(texture_diffuse1, TexCoords));
     vec3 diffuse = light.diffuse * diff * vec3(texture(texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(texture_specular1, TexCoords));
+    vec3 specular = Specular(light.specular, lightDir, normal, viewDir);
     return (ambient + diffuse + specular);
 }
 
-// calculates the color when using a point light.
-vec3 CalcPointLightShadow(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+// calculates the color when using a point light, shadow is the shadowed fraction of the fragment
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow)
 {
-    float shadow = ShadowCalculation(FragPosLightSpace, light.position); 
-
     vec3 lightDir = normalize(light.position - fragPos);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // attenuation
     float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
     // combine results
     vec3 ambient = light.ambient * vec3(texture(texture_diffuse1, TexCoords));
     vec3 diffuse = (1-shadow) * light.diffuse * diff * vec3(texture(texture_diffuse1, TexCoords));
-    vec3 specular = (1-shadow) * light.specular * spec * vec3(texture(texture_specular1, TexCoords));
+    vec3 specular = (1-shadow) * Specular(light.specular, lightDir, normal, viewDir);
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
     return (ambient + diffuse + specular);
 }
 
-// calculates the color when using a point light.
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+// specular shading, left out of the variants without highlights
+vec3 Specular(vec3 lightSpecular, vec3 lightDir, vec3 normal, vec3 viewDir)
 {
-    vec3 lightDir = normalize(light.position - fragPos);
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
+#if SPECULAR
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    // attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
-    // combine results
-    vec3 ambient = light.ambient * vec3(texture(texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(texture_specular1, TexCoords));
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-    return (ambient + diffuse + specular);
-}
-
-// calculates the color when using a spot light.
-vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-    // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    // attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
-    // spotlight intensity
-    float theta = dot(lightDir, normalize(-light.direction)); 
-    float epsilon = light.cutOff - light.outerCutOff;
-    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
-    // combine results
-    vec3 ambient = light.ambient * vec3(texture(texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(texture_specular1, TexCoords));
-    ambient *= attenuation * intensity;
-    diffuse *= attenuation * intensity;
-    specular *= attenuation * intensity;
-    return (ambient + diffuse + specular);
+    return lightSpecular * spec * vec3(texture(texture_specular1, TexCoords));
+#else
+    return vec3(0.0);
+#endif
 }
 
+#if SHADOWS
 float ShadowCalculation(vec4 fragPosLightSpace, vec3 lightPos)
 {
     // perform perspective divide
@@ -202,19 +172,20 @@ float ShadowCalculation(vec4 fragPosLightSpace, vec3 lightPos)
     // PCF
     float shadow = 0.0;
     vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-    for(int x = -1; x <= 1; ++x)
+    for(int x = -PCF_RADIUS; x <= PCF_RADIUS; ++x)
     {
-        for(int y = -1; y <= 1; ++y)
+        for(int y = -PCF_RADIUS; y <= PCF_RADIUS; ++y)
         {
             float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r; 
             shadow += currentDepth - bias > pcfDepth  ? 1.0 : 0.0;        
         }    
     }
-    shadow /= 9.0;
+    shadow /= float((2 * PCF_RADIUS + 1) * (2 * PCF_RADIUS + 1));
     
     // keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
     if(projCoords.z > 1.0)
         shadow = 0.0;
         
     return shadow;
-}
\ No newline at end of file
+}
+#endif
@@ -1,4 +1,7 @@
 #version 330 core
+#ifndef SHADOWS
+#define SHADOWS 1
+#endif
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
@@ -6,19 +9,32 @@ layout (location = 2) in vec2 aTexCoords;
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+#if SHADOWS
 out vec4 FragPosLightSpace;
+#endif
+
+// shared blocks, see scene_uniforms.h
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+};
+#if SHADOWS
+layout (std140) uniform Shadow {
+    mat4 lightSpaceMatrix;
+};
+#endif
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 lightSpaceMatrix;
 
 void main()
 {
     FragPos = vec3(model * vec4(aPos, 1.0));
     Normal = mat3(transpose(inverse(model))) * aNormal;  
     TexCoords = aTexCoords;
+#if SHADOWS
     FragPosLightSpace = lightSpaceMatrix * vec4(FragPos, 1.0);
+#endif
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
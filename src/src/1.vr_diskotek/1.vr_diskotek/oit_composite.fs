@@ -0,0 +1,19 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D accumTexture;  // rgb: sum of color * alpha * weight, a: revealage
+uniform sampler2D weightTexture; // r: sum of alpha * weight
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    vec4 accum = texelFetch(accumTexture, texel, 0);
+    float revealage = accum.a;
+    if (revealage >= 1.0)
+        discard; // nothing translucent covers this pixel
+
+    float weight = texelFetch(weightTexture, texel, 0).r;
+    vec3 average = accum.rgb / max(weight, 1e-5);
+    // blended over the opaque color with GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+    FragColor = vec4(average, 1.0 - revealage);
+}
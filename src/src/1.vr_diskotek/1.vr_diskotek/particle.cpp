@@ -1,3 +1,6 @@
+#ifndef PARTICLE_H
+#define PARTICLE_H
+
 #include <iostream>
 
 #include <glm/glm.hpp>
@@ -13,12 +16,7 @@ class Particle
         glm::vec4 color;
         float size, angle, weight;
         float life;
-        float cameradistance;
-
-        Particle():pos(0.0f), speed(0.0f), color(1.0f), life(-1.0f), size(10.0f) { }
 
-        bool operator<(const Particle& that) const {
-            // Sort in reverse order : far particles drawn first.
-            return this->cameradistance > that.cameradistance;
-        }
-}; 
\ No newline at end of file
+        Particle():pos(0.0f), speed(0.0f), color(1.0f), size(10.0f), life(-1.0f) { }
+};
+#endif
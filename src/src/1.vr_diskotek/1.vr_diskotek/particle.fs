@@ -1,11 +1,27 @@
 #version 330 core
 in vec2 TexCoords;
 in vec4 ParticleColor;
-out vec4 color;
+layout (location = 0) out vec4 color;
+layout (location = 1) out float OITWeight;
 
 uniform sampler2D sprite;
+uniform bool weightedOIT;
+
+// depth weight of weighted blended OIT (McGuire & Bavoil 2013, eq. 10)
+float oitWeight(float alpha)
+{
+    float distance = 1.0 - gl_FragCoord.z;
+    return alpha * clamp(3e3 * distance * distance * distance, 1e-2, 3e3);
+}
 
 void main()
 {
-    color = (texture(sprite, TexCoords) * ParticleColor);
-}
\ No newline at end of file
+    vec4 texel = (texture(sprite, TexCoords) * ParticleColor);
+    if (weightedOIT) {
+        float weight = oitWeight(texel.a);
+        color = vec4(texel.rgb * weight, texel.a);
+        OITWeight = weight;
+    } else {
+        color = texel;
+    }
+}
@@ -1,18 +1,23 @@
 #version 330 core
 layout (location = 0) in vec4 vertex; // <vec2 position, vec2 texCoords>
+layout (location = 1) in vec3 offset; // per instance
+layout (location = 2) in vec4 color;  // per instance
 
 out vec2 TexCoords;
 out vec4 ParticleColor;
 
 uniform mat4 projection;
 uniform mat4 view;
-uniform vec3 offset;
-uniform vec4 color;
+uniform float scale; // sprite size
+uniform vec3 origin; // instances hold offsets from it
+uniform float colorScale;
 
 void main()
 {
-    float scale = 0.05f;
     TexCoords = vertex.zw;
-    ParticleColor = color;
-    gl_Position = projection * view * vec4((vertex.xyz * scale) + offset, 1.0);
+    ParticleColor = vec4(color.rgb * colorScale, color.a);
+    gl_Position = projection * view * vec4((vertex.xyz * scale) + origin + offset, 1.0);
+    // dead slots of the GPU backend have a zero alpha: move them out of the clip volume
+    if (color.a <= 0.0)
+        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,470 @@
+#ifndef PARTICLE_CACHE_H
+#define PARTICLE_CACHE_H
+
+#include <glm/glm.hpp>
+#include <learnopengl/mapped_file.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "particle_store.h"
+#include "particle_compact.h"
+
+// what the fountains do with their particle caches
+enum ParticleCacheMode {
+    PARTICLE_CACHE_OFF,    // simulate live
+    PARTICLE_CACHE_RECORD, // simulate live and bake the particles into the cache files
+    PARTICLE_CACHE_PLAY    // play the cache files back, nothing is simulated
+};
+
+// Layout of a cache file: the header, the frames one after the other, then the index of frame
+// offsets. A frame is a ParticleCacheFrame followed by its particles as CompactParticleInstance
+// records (half float offsets from the header's origin, RGBA8 colors) in spawn order.
+const char PARTICLE_CACHE_MAGIC[8] = { 'P', 'C', 'A', 'C', 'H', 'E', '0', '1' };
+
+struct ParticleCacheHeader
+{
+    char magic[8];
+    uint32_t frameCount;
+    uint32_t maxParticles; // of the largest frame
+    float rate;            // frames per second
+    float origin[3];
+    uint64_t indexOffset;  // frameCount uint64_t file offsets
+};
+
+struct ParticleCacheFrame
+{
+    // Spawn number of the first particle. An emitter's particles all live as long, so the live
+    // ones are always the last count spawned and the same particle in two frames is found by
+    // its spawn number.
+    uint64_t firstSerial;
+    uint32_t count;
+    uint32_t padding;
+};
+
+// Bakes the particles of one emitter at a fixed rate. Call record() every simulated frame,
+// it keeps one sample per 1 / rate seconds, and close() to write the index.
+class ParticleCacheWriter
+{
+public:
+    ParticleCacheWriter() : file(NULL), elapsed(0.0f) { }
+
+    ~ParticleCacheWriter()
+    {
+        this->close();
+    }
+
+    bool open(const std::string &path, float rate, const glm::vec3 &origin)
+    {
+        this->close();
+        this->file = fopen(path.c_str(), "wb");
+        if (!this->file) {
+            std::cout << "ERROR::PARTICLE_CACHE::CANNOT_WRITE " << path << std::endl;
+            return false;
+        }
+        memset(&this->header, 0, sizeof(this->header));
+        memcpy(this->header.magic, PARTICLE_CACHE_MAGIC, sizeof(this->header.magic));
+        this->header.rate = rate;
+        this->header.origin[0] = origin.x; this->header.origin[1] = origin.y; this->header.origin[2] = origin.z;
+        this->offsets.clear();
+        // the first sample is taken by the first record()
+        this->elapsed = 1.0f / rate;
+        fwrite(&this->header, sizeof(this->header), 1, this->file);
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return this->file != NULL;
+    }
+
+    // samples recorded so far
+    unsigned int frameCount() const
+    {
+        return (unsigned int)this->offsets.size();
+    }
+
+    // Samples the live particles once delta has completed a sample interval. firstSerial is the
+    // spawn number of the particle at particles.first.
+    template <class Store>
+    void record(float delta, const Store &particles, uint64_t firstSerial)
+    {
+        if (!this->file)
+            return;
+        this->elapsed += delta;
+        float interval = 1.0f / this->header.rate;
+        if (this->elapsed < interval)
+            return;
+        this->elapsed -= interval;
+        if (this->elapsed >= interval)
+            this->elapsed = 0.0f; // a long frame: don't try to catch up with repeated samples
+
+        this->instances.resize(particles.count);
+        this->capture(particles, this->instances.data());
+        ParticleCacheFrame frame;
+        frame.firstSerial = firstSerial;
+        frame.count = particles.count;
+        frame.padding = 0;
+        this->offsets.push_back((uint64_t)ftell(this->file));
+        fwrite(&frame, sizeof(frame), 1, this->file);
+        fwrite(this->instances.data(), sizeof(CompactParticleInstance), particles.count, this->file);
+        if (particles.count > this->header.maxParticles)
+            this->header.maxParticles = particles.count;
+    }
+
+    void close()
+    {
+        if (!this->file)
+            return;
+        this->header.frameCount = (uint32_t)this->offsets.size();
+        this->header.indexOffset = (uint64_t)ftell(this->file);
+        if (!this->offsets.empty())
+            fwrite(this->offsets.data(), sizeof(uint64_t), this->offsets.size(), this->file);
+        fseek(this->file, 0, SEEK_SET);
+        fwrite(&this->header, sizeof(this->header), 1, this->file);
+        fclose(this->file);
+        this->file = NULL;
+    }
+
+private:
+    FILE *file;
+    ParticleCacheHeader header;
+    std::vector<uint64_t> offsets;
+    std::vector<CompactParticleInstance> instances; // scratch, kept to avoid per-frame allocations
+    float elapsed;
+
+    glm::vec3 origin() const
+    {
+        return glm::vec3(this->header.origin[0], this->header.origin[1], this->header.origin[2]);
+    }
+
+    void capture(const ParticleStore &particles, CompactParticleInstance *out) const
+    {
+        glm::vec3 origin = this->origin();
+        for (unsigned int i = 0; i < particles.count; i++) {
+            glm::vec3 offset = particles.position(particles.first + i) - origin;
+            out[i].offset[0] = floatToHalf(offset.x);
+            out[i].offset[1] = floatToHalf(offset.y);
+            out[i].offset[2] = floatToHalf(offset.z);
+            out[i].offset[3] = 0;
+            out[i].color = CompactParticleStore::packColor(particles.color(particles.first + i));
+        }
+    }
+
+    void capture(const CompactParticleStore &particles, CompactParticleInstance *out) const
+    {
+        particles.packInstances(out, particles.first, particles.count);
+        // rebase when the store keeps its offsets from somewhere else
+        glm::vec3 shift = particles.origin - this->origin();
+        if (shift == glm::vec3(0.0f))
+            return;
+        for (unsigned int i = 0; i < particles.count; i++) {
+            for (int k = 0; k < 3; k++)
+                out[i].offset[k] = floatToHalf(halfToFloat(out[i].offset[k]) + shift[k]);
+        }
+    }
+
+    ParticleCacheWriter(const ParticleCacheWriter&);
+    ParticleCacheWriter& operator=(const ParticleCacheWriter&);
+};
+
+// Plays a cache file back. The file is memory mapped and only the pages of the two frames
+// around the play head, plus a few frames of read-ahead, are kept resident: pages behind the
+// play head are handed back to the kernel, so the footprint does not grow with the length of
+// the cache. Between two samples the particles found in both are interpolated linearly.
+class ParticleCache
+{
+public:
+    bool loop;
+    unsigned int prefetchFrames; // read ahead of the play head
+
+    ParticleCache() : loop(true), prefetchFrames(4), header(NULL), index(NULL), time(0.0f),
+                      windowBegin(0), windowEnd(0) { }
+
+    ~ParticleCache()
+    {
+        this->close();
+    }
+
+    bool open(const std::string &path)
+    {
+        this->close();
+        if (!this->file.open(path)) {
+            std::cout << "ERROR::PARTICLE_CACHE::CANNOT_READ " << path << std::endl;
+            return false;
+        }
+#ifndef _WIN32
+        // played back through the residency window below, not front to back
+        madvise((void*)this->file.data(), this->file.size(), MADV_NORMAL);
+#endif
+        this->header = (const ParticleCacheHeader*)this->file.data();
+        if (this->file.size() < sizeof(ParticleCacheHeader) || memcmp(this->header->magic, PARTICLE_CACHE_MAGIC, sizeof(PARTICLE_CACHE_MAGIC)) != 0 ||
+            this->header->frameCount == 0 || this->header->rate <= 0.0f ||
+            this->header->indexOffset > this->file.size() || (this->file.size() - this->header->indexOffset) / sizeof(uint64_t) < this->header->frameCount) {
+            std::cout << "ERROR::PARTICLE_CACHE::INVALID " << path << std::endl;
+            this->close();
+            return false;
+        }
+        this->index = (const uint64_t*)(this->file.data() + this->header->indexOffset);
+        if (!this->validFrames()) {
+            std::cout << "ERROR::PARTICLE_CACHE::INVALID " << path << std::endl;
+            this->close();
+            return false;
+        }
+        this->seek(0.0f);
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return this->file.isOpen();
+    }
+
+    unsigned int frameCount() const { return this->header->frameCount; }
+    unsigned int maxParticles() const { return this->header->maxParticles; }
+    float duration() const { return (this->header->frameCount - 1) / this->header->rate; }
+    float playhead() const { return this->time; }
+    glm::vec3 origin() const { return glm::vec3(this->header->origin[0], this->header->origin[1], this->header->origin[2]); }
+
+    // Moves the play head, wrapping around when looping and stopping at the ends otherwise.
+    void seek(float seconds)
+    {
+        float length = this->duration();
+        if (length <= 0.0f)
+            seconds = 0.0f;
+        else if (this->loop)
+            seconds -= std::floor(seconds / length) * length;
+        else
+            seconds = std::min(std::max(seconds, 0.0f), length);
+        this->time = seconds;
+        unsigned int sample, next;
+        float t;
+        this->samples(sample, next, t);
+        this->keepResident(sample, next);
+    }
+
+    void advance(float delta)
+    {
+        this->seek(this->time + delta);
+    }
+
+    // particles unpack() writes at the play head
+    unsigned int count() const
+    {
+        unsigned int sample, next;
+        float t;
+        this->samples(sample, next, t);
+        uint64_t begin, end;
+        this->range(sample, next, t, begin, end);
+        return (unsigned int)(end - begin);
+    }
+
+    // Writes up to max particles at the play head as <vec3 position, vec4 color> float records,
+    // the position relative to origin. Returns the number written.
+    unsigned int unpack(float *out, unsigned int max, const glm::vec3 &origin = glm::vec3(0.0f)) const
+    {
+        glm::vec3 shift = this->origin() - origin;
+        return this->interpolate(max, [&](const glm::vec3 &offset, const glm::vec4 &color) {
+            glm::vec3 p = offset + shift;
+            out[0] = p.x;     out[1] = p.y;     out[2] = p.z;
+            out[3] = color.r; out[4] = color.g; out[5] = color.b; out[6] = color.a;
+            out += PARTICLE_INSTANCE_FLOATS;
+        });
+    }
+
+    // same as above as CompactParticleInstance records
+    unsigned int unpack(CompactParticleInstance *out, unsigned int max, const glm::vec3 &origin) const
+    {
+        glm::vec3 shift = this->origin() - origin;
+        return this->interpolate(max, [&](const glm::vec3 &offset, const glm::vec4 &color) {
+            glm::vec3 p = offset + shift;
+            out->offset[0] = floatToHalf(p.x);
+            out->offset[1] = floatToHalf(p.y);
+            out->offset[2] = floatToHalf(p.z);
+            out->offset[3] = 0;
+            out->color = CompactParticleStore::packColor(color);
+            out++;
+        });
+    }
+
+    // bytes of the file the cache keeps mapped in, an upper bound of its resident memory
+    size_t residentBytes() const
+    {
+        return this->windowEnd - this->windowBegin;
+    }
+
+    void close()
+    {
+        if (!this->file.isOpen())
+            return;
+        this->file.close();
+        this->header = NULL;
+        this->index = NULL;
+        this->windowBegin = this->windowEnd = 0;
+    }
+
+private:
+    const ParticleCacheHeader *header;
+    const uint64_t *index;
+    MappedFile file;
+    float time;
+    size_t windowBegin, windowEnd; // page aligned byte range kept resident
+
+    const ParticleCacheFrame &frame(unsigned int k) const
+    {
+        return *(const ParticleCacheFrame*)(this->file.data() + this->index[k]);
+    }
+
+    const CompactParticleInstance *particles(unsigned int k) const
+    {
+        return (const CompactParticleInstance*)(this->file.data() + this->index[k] + sizeof(ParticleCacheFrame));
+    }
+
+    // every frame inside the file, after the previous one (the residency window relies on it)
+    // and no larger than the header says
+    bool validFrames() const
+    {
+        uint64_t previousEnd = sizeof(ParticleCacheHeader);
+        for (unsigned int k = 0; k < this->header->frameCount; k++) {
+            uint64_t offset = this->index[k];
+            if (offset < previousEnd || offset > this->file.size() || this->file.size() - offset < sizeof(ParticleCacheFrame))
+                return false;
+            uint32_t count = this->frame(k).count;
+            uint64_t end = offset + sizeof(ParticleCacheFrame) + (uint64_t)count * sizeof(CompactParticleInstance);
+            if (count > this->header->maxParticles || end > this->file.size())
+                return false;
+            previousEnd = end;
+        }
+        return true;
+    }
+
+    size_t frameEnd(unsigned int k) const
+    {
+        return (size_t)this->index[k] + sizeof(ParticleCacheFrame) + (size_t)this->frame(k).count * sizeof(CompactParticleInstance);
+    }
+
+    // the two samples around the play head and how far it is between them
+    void samples(unsigned int &sample, unsigned int &next, float &t) const
+    {
+        unsigned int last = this->header->frameCount - 1;
+        float position = this->time * this->header->rate;
+        sample = std::min((unsigned int)position, last);
+        next = std::min(sample + 1, last);
+        t = next == sample ? 0.0f : std::min(position - sample, 1.0f);
+    }
+
+    // Calls emit(offset, color) for every particle at the play head, at most max of them.
+    template <class Emit>
+    unsigned int interpolate(unsigned int max, Emit emit) const
+    {
+        unsigned int sample, next;
+        float t;
+        this->samples(sample, next, t);
+        const ParticleCacheFrame &a = this->frame(sample), &b = this->frame(next);
+        const CompactParticleInstance *from = this->particles(sample), *to = this->particles(next);
+
+        uint64_t begin, end;
+        this->range(sample, next, t, begin, end);
+        uint64_t bothBegin = b.firstSerial;
+        uint64_t bothEnd = a.firstSerial + a.count;
+        unsigned int written = 0;
+        for (uint64_t serial = begin; serial < end && written < max; serial++, written++) {
+            bool inA = serial < bothEnd, inB = serial >= bothBegin;
+            const CompactParticleInstance &p = inA ? from[serial - a.firstSerial] : to[serial - b.firstSerial];
+            glm::vec3 offset = unpackOffset(p);
+            glm::vec4 color = unpackColor(p.color);
+            if (inA && inB) {
+                const CompactParticleInstance &q = to[serial - b.firstSerial];
+                offset = glm::mix(offset, unpackOffset(q), t);
+                color = glm::mix(color, unpackColor(q.color), t);
+            }
+            emit(offset, color);
+        }
+        return written;
+    }
+
+    // Spawn numbers drawn between two samples, which only ever grow. The particles found in both
+    // are always drawn; the ones that die before the next sample stay until half way, the ones
+    // born since show up from half way where the next sample has them.
+    void range(unsigned int sample, unsigned int next, float t, uint64_t &begin, uint64_t &end) const
+    {
+        const ParticleCacheFrame &f = this->frame(t < 0.5f ? sample : next);
+        begin = f.firstSerial;
+        end = f.firstSerial + f.count;
+    }
+
+    static glm::vec3 unpackOffset(const CompactParticleInstance &p)
+    {
+        return glm::vec3(halfToFloat(p.offset[0]), halfToFloat(p.offset[1]), halfToFloat(p.offset[2]));
+    }
+
+    static glm::vec4 unpackColor(uint32_t packed)
+    {
+        glm::vec4 c;
+        for (int k = 0; k < 4; k++)
+            c[k] = ((packed >> (8 * k)) & 0xFFu) / 255.0f;
+        return glm::vec4(glm::vec3(c) * PARTICLE_COLOR_RANGE, c.a);
+    }
+
+    // Keeps the pages of the frames from sample to a few past next mapped in and gives the
+    // ones that fell out of that window back.
+    void keepResident(unsigned int sample, unsigned int next)
+    {
+        unsigned int last = std::min(next + this->prefetchFrames, this->header->frameCount - 1);
+        size_t page = pageSize();
+        size_t begin = (size_t)this->index[sample] / page * page;
+        size_t end = std::min((this->frameEnd(last) + page - 1) / page * page, (this->file.size() + page - 1) / page * page);
+        if (begin == this->windowBegin && end == this->windowEnd)
+            return;
+        if (this->windowBegin < std::min(begin, this->windowEnd))
+            this->release(this->windowBegin, std::min(begin, this->windowEnd));
+        if (std::max(end, this->windowBegin) < this->windowEnd)
+            this->release(std::max(end, this->windowBegin), this->windowEnd);
+#ifndef _WIN32
+        madvise((void*)(this->file.data() + begin), end - begin, MADV_WILLNEED);
+#endif
+        this->windowBegin = begin;
+        this->windowEnd = end;
+    }
+
+    void release(size_t begin, size_t end)
+    {
+#ifdef _WIN32
+        // unlocking pages that are not locked evicts them from the working set
+        VirtualUnlock((void*)(this->file.data() + begin), end - begin);
+#else
+        madvise((void*)(this->file.data() + begin), end - begin, MADV_DONTNEED);
+#endif
+    }
+
+    static size_t pageSize()
+    {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwAllocationGranularity;
+#else
+        return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    }
+
+    ParticleCache(const ParticleCache&);
+    ParticleCache& operator=(const ParticleCache&);
+};
+#endif
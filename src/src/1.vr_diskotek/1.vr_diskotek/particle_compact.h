@@ -0,0 +1,423 @@
+#ifndef PARTICLE_COMPACT_H
+#define PARTICLE_COMPACT_H
+
+#include <stdint.h>
+#include <cstring>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "particle_store.h"
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#define PARTICLE_COMPACT_F16C
+#endif
+
+// particles processed per block of the compact kernel, eight 16-bit values fill an SSE register
+const unsigned int PARTICLE_COMPACT_WIDTH = 8;
+// slots per stream are padded to this, which keeps every stream 32 byte aligned
+const unsigned int PARTICLE_COMPACT_PADDING = 16;
+// resolution of the 16-bit life ticker: lifetimes up to 65535 / 8192 ~ 8 seconds
+const float PARTICLE_LIFE_TICKS_PER_SECOND = 8192.0f;
+// colors are stored as RGBA8 of rgb / PARTICLE_COLOR_RANGE, so they may go above 1
+const float PARTICLE_COLOR_RANGE = 2.0f;
+
+// IEEE 754 half precision conversions, rounding to nearest even
+inline uint16_t floatToHalf(float value)
+{
+    const uint32_t f32infinity = 255u << 23;
+    const uint32_t f16overflow = (127u + 16u) << 23;
+    const uint32_t denormMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+    uint16_t half;
+    if (bits >= f16overflow)
+        half = bits > f32infinity ? 0x7E00 : 0x7C00; // NaN stays NaN, the rest becomes infinity
+    else if (bits < (113u << 23))
+    {
+        // subnormal result: let the FPU round the mantissa by adding a magic number
+        float f, magic;
+        memcpy(&f, &bits, sizeof(f));
+        memcpy(&magic, &denormMagic, sizeof(magic));
+        f += magic;
+        memcpy(&bits, &f, sizeof(bits));
+        half = (uint16_t)(bits - denormMagic);
+    }
+    else
+    {
+        uint32_t odd = (bits >> 13) & 1u;
+        bits += ((uint32_t)(15 - 127) << 23) + 0xFFFu + odd;
+        half = (uint16_t)(bits >> 13);
+    }
+    return half | (uint16_t)(sign >> 16);
+}
+
+inline float halfToFloat(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1Fu;
+    uint32_t mantissa = half & 0x3FFu;
+    uint32_t bits;
+    if (exponent == 0x1Fu)
+        bits = sign | 0x7F800000u | (mantissa << 13);
+    else if (exponent != 0)
+        bits = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+    else if (mantissa == 0)
+        bits = sign;
+    else
+    {
+        // subnormal half: normalize it
+        exponent = 113;
+        while (!(mantissa & 0x400u))
+        {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3FFu) << 13);
+    }
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// one instance record of the compact format, streamed to particle.vs: the offset from the
+// emitter origin as half floats (GL_HALF_FLOAT, the fourth one is padding) and RGBA8 color
+struct CompactParticleInstance
+{
+    uint16_t offset[4];
+    uint32_t color;
+};
+
+// Compact counterpart of ParticleStore: the same structure-of-arrays layout and the same API,
+// but every particle only takes 18 bytes of state instead of 44:
+//   position  3 x fp16, relative to origin
+//   speed     3 x fp16
+//   life      16-bit ticker, counting down in 1 / PARTICLE_LIFE_TICKS_PER_SECOND
+//   color     RGBA8
+// plus the float rank used by ParticleSorter. The simulation kernel reads and writes this
+// format directly (with F16C when the compiler targets it) and packInstances() hands it to
+// the GPU as is, so an instance record shrinks from 28 to 12 bytes.
+class CompactParticleStore
+{
+public:
+    // streams
+    uint16_t *posX, *posY, *posZ;
+    uint16_t *speedX, *speedY, *speedZ;
+    uint16_t *life;
+    uint32_t *color;
+    float *rank;
+
+    glm::vec3 origin; // positions are stored relative to it
+    unsigned int first;
+    unsigned int count;
+    unsigned int capacity;
+
+    CompactParticleStore() : origin(0.0f), first(0), count(0), capacity(0), slots(0), stride(0), block(NULL)
+    {
+        assignStreams();
+    }
+
+    explicit CompactParticleStore(unsigned int capacity, unsigned int headroom = 0)
+        : origin(0.0f), first(0), count(0), capacity(0), slots(0), stride(0), block(NULL)
+    {
+        allocate(capacity, headroom);
+    }
+
+    ~CompactParticleStore()
+    {
+        release();
+    }
+
+    // same as ParticleStore::allocate()
+    void allocate(unsigned int newCapacity, unsigned int headroom = 0)
+    {
+        release();
+        capacity = newCapacity;
+        slots = newCapacity + headroom;
+        stride = (slots + PARTICLE_COMPACT_PADDING - 1) / PARTICLE_COMPACT_PADDING * PARTICLE_COMPACT_PADDING;
+        size_t bytes = (size_t)stride * BYTES_PER_SLOT;
+        if (bytes > 0)
+        {
+            block = (unsigned char*)particleAlignedAlloc(bytes);
+            memset(block, 0, bytes);
+        }
+        assignStreams();
+    }
+
+    void allocateLike(const CompactParticleStore &other)
+    {
+        allocate(other.capacity, other.slots - other.capacity);
+    }
+
+    int push()
+    {
+        if (count == capacity || first + count == slots)
+            return -1;
+        return (int)(first + count++);
+    }
+
+    void retireOldest()
+    {
+        if (count == 0)
+            return;
+        first++;
+        count--;
+    }
+
+    // writes a single particle into slot i, pos is in world space
+    void set(unsigned int i, const glm::vec3 &pos, const glm::vec3 &speed, const glm::vec4 &c, float lifetime)
+    {
+        glm::vec3 offset = pos - origin;
+        posX[i] = floatToHalf(offset.x);  posY[i] = floatToHalf(offset.y);  posZ[i] = floatToHalf(offset.z);
+        speedX[i] = floatToHalf(speed.x); speedY[i] = floatToHalf(speed.y); speedZ[i] = floatToHalf(speed.z);
+        float ticks = lifetime * PARTICLE_LIFE_TICKS_PER_SECOND + 0.5f;
+        life[i] = (uint16_t)std::min(std::max(ticks, 0.0f), 65535.0f);
+        color[i] = packColor(c);
+        rank[i] = -1.0f;
+    }
+
+    // RGBA8 with the rgb scaled down by PARTICLE_COLOR_RANGE, as the color stream keeps it
+    static uint32_t packColor(const glm::vec4 &c)
+    {
+        glm::vec4 scaled = glm::vec4(glm::vec3(c) / PARTICLE_COLOR_RANGE, c.a);
+        uint32_t packed = 0;
+        for (int k = 0; k < 4; k++)
+        {
+            float v = std::min(std::max(scaled[k], 0.0f), 1.0f);
+            packed |= (uint32_t)(v * 255.0f + 0.5f) << (8 * k);
+        }
+        return packed;
+    }
+
+    glm::vec3 position(unsigned int i) const
+    {
+        return origin + glm::vec3(halfToFloat(posX[i]), halfToFloat(posY[i]), halfToFloat(posZ[i]));
+    }
+
+    glm::vec3 speed(unsigned int i) const
+    {
+        return glm::vec3(halfToFloat(speedX[i]), halfToFloat(speedY[i]), halfToFloat(speedZ[i]));
+    }
+
+    float lifetime(unsigned int i) const
+    {
+        return life[i] / PARTICLE_LIFE_TICKS_PER_SECOND;
+    }
+
+    void packInstances(CompactParticleInstance *out, unsigned int first, unsigned int n) const
+    {
+        for (unsigned int i = first; i < first + n; i++, out++)
+            packInstance(i, out);
+    }
+
+    void packInstances(CompactParticleInstance *out, const unsigned int *order, unsigned int n) const
+    {
+        for (unsigned int j = 0; j < n; j++, out++)
+            packInstance(order[j], out);
+    }
+
+    // same contract as ParticleStore::simulate()
+    unsigned int simulate(float delta)
+    {
+        const uint16_t ticks = lifeTicks(delta);
+        const unsigned int end = first + count;
+        unsigned int write = 0;
+        for (unsigned int i = first / PARTICLE_COMPACT_WIDTH * PARTICLE_COMPACT_WIDTH; i < end; i += PARTICLE_COMPACT_WIDTH)
+        {
+            unsigned int alive = integrateBlock(i, delta, ticks) & laneMask(i, first, end);
+            write = copySurvivors(*this, i, alive, *this, write);
+        }
+        first = 0;
+        count = write;
+        return count;
+    }
+
+    // same contract as ParticleStore::integrate() and gather(), with ranges handled
+    // concurrently starting on a multiple of PARTICLE_COMPACT_WIDTH
+    unsigned int integrate(unsigned int begin, unsigned int end, float delta)
+    {
+        const uint16_t ticks = lifeTicks(delta);
+        clipToLiveRange(begin, end);
+        unsigned int survivors = 0;
+        for (unsigned int i = begin / PARTICLE_COMPACT_WIDTH * PARTICLE_COMPACT_WIDTH; i < end; i += PARTICLE_COMPACT_WIDTH)
+            survivors += countBits(integrateBlock(i, delta, ticks) & laneMask(i, begin, end));
+        return survivors;
+    }
+
+    void gather(unsigned int begin, unsigned int end, CompactParticleStore &dst, unsigned int offset) const
+    {
+        clipToLiveRange(begin, end);
+        for (unsigned int i = begin / PARTICLE_COMPACT_WIDTH * PARTICLE_COMPACT_WIDTH; i < end; i += PARTICLE_COMPACT_WIDTH)
+            offset = copySurvivors(*this, i, aliveBlock(i) & laneMask(i, begin, end), dst, offset);
+    }
+
+    // the origins stay: gather() copies the offsets as they are, so they belong to this origin
+    void swap(CompactParticleStore &other)
+    {
+        std::swap(first, other.first);
+        std::swap(count, other.count);
+        std::swap(capacity, other.capacity);
+        std::swap(slots, other.slots);
+        std::swap(stride, other.stride);
+        std::swap(block, other.block);
+        assignStreams();
+        other.assignStreams();
+    }
+
+private:
+    // 7 half / ticker streams, the color and the rank
+    static const unsigned int BYTES_PER_SLOT = 7 * sizeof(uint16_t) + sizeof(uint32_t) + sizeof(float);
+    unsigned int slots;
+    unsigned int stride;
+    unsigned char *block;
+
+    CompactParticleStore(const CompactParticleStore&);
+    CompactParticleStore& operator=(const CompactParticleStore&);
+
+    void assignStreams()
+    {
+        uint16_t **halves[7] = { &posX, &posY, &posZ, &speedX, &speedY, &speedZ, &life };
+        size_t offset = 0;
+        for (unsigned int s = 0; s < 7; s++, offset += (size_t)stride * sizeof(uint16_t))
+            *halves[s] = block ? (uint16_t*)(block + offset) : NULL;
+        color = block ? (uint32_t*)(block + offset) : NULL;
+        offset += (size_t)stride * sizeof(uint32_t);
+        rank = block ? (float*)(block + offset) : NULL;
+    }
+
+    void release()
+    {
+        if (block)
+            particleAlignedFree(block);
+        block = NULL;
+        first = count = capacity = slots = stride = 0;
+        assignStreams();
+    }
+
+    void packInstance(unsigned int i, CompactParticleInstance *out) const
+    {
+        out->offset[0] = posX[i];
+        out->offset[1] = posY[i];
+        out->offset[2] = posZ[i];
+        out->offset[3] = 0;
+        out->color = color[i];
+    }
+
+    // whole ticks elapsed in delta seconds
+    static uint16_t lifeTicks(float delta)
+    {
+        float ticks = delta * PARTICLE_LIFE_TICKS_PER_SECOND + 0.5f;
+        return (uint16_t)std::min(std::max(ticks, 0.0f), 65535.0f);
+    }
+
+    void clipToLiveRange(unsigned int &begin, unsigned int &end) const
+    {
+        if (begin < first)
+            begin = first;
+        if (end > first + count)
+            end = first + count;
+    }
+
+    static unsigned int laneMask(unsigned int i, unsigned int begin, unsigned int end)
+    {
+        unsigned int lo = begin > i ? begin - i : 0;
+        unsigned int hi = end - i < PARTICLE_COMPACT_WIDTH ? end - i : PARTICLE_COMPACT_WIDTH;
+        return ((1u << hi) - 1u) & ~((1u << lo) - 1u);
+    }
+
+    static unsigned int countBits(unsigned int mask)
+    {
+        unsigned int bits = 0;
+        for (; mask; mask &= mask - 1u)
+            bits++;
+        return bits;
+    }
+
+    static unsigned int copySurvivors(const CompactParticleStore &src, unsigned int i, unsigned int alive, CompactParticleStore &dst, unsigned int write)
+    {
+        if (alive == (1u << PARTICLE_COMPACT_WIDTH) - 1u)
+        {
+            if (&src != &dst || write != i)
+                copyParticles(src, i, dst, write, PARTICLE_COMPACT_WIDTH);
+            return write + PARTICLE_COMPACT_WIDTH;
+        }
+        for (unsigned int lane = 0; alive; lane++, alive >>= 1)
+        {
+            if (alive & 1u)
+            {
+                if (&src != &dst || write != i + lane)
+                    copyParticles(src, i + lane, dst, write, 1);
+                write++;
+            }
+        }
+        return write;
+    }
+
+    // copies n consecutive particles; the ranges may only overlap with to <= from
+    static void copyParticles(const CompactParticleStore &src, unsigned int from, CompactParticleStore &dst, unsigned int to, unsigned int n)
+    {
+        const uint16_t *srcHalves[7] = { src.posX, src.posY, src.posZ, src.speedX, src.speedY, src.speedZ, src.life };
+        uint16_t *dstHalves[7] = { dst.posX, dst.posY, dst.posZ, dst.speedX, dst.speedY, dst.speedZ, dst.life };
+        for (unsigned int s = 0; s < 7; s++)
+            memmove(dstHalves[s] + to, srcHalves[s] + from, n * sizeof(uint16_t));
+        memmove(dst.color + to, src.color + from, n * sizeof(uint32_t));
+        memmove(dst.rank + to, src.rank + from, n * sizeof(float));
+    }
+
+    unsigned int aliveBlock(unsigned int i) const
+    {
+        unsigned int alive = 0;
+        for (unsigned int lane = 0; lane < PARTICLE_COMPACT_WIDTH; lane++)
+            alive |= (life[i + lane] != 0 ? 1u : 0u) << lane;
+        return alive;
+    }
+
+    // integrates PARTICLE_COMPACT_WIDTH particles starting at i in place and returns the alive
+    // lane mask; same physics as ParticleStore, the ticker saturates at zero
+#if defined(PARTICLE_COMPACT_F16C)
+    unsigned int integrateBlock(unsigned int i, float delta, uint16_t ticks)
+    {
+        __m128i l = _mm_subs_epu16(_mm_load_si128((const __m128i*)(life + i)), _mm_set1_epi16((short)ticks));
+        _mm_store_si128((__m128i*)(life + i), l);
+
+        const __m256 dt = _mm256_set1_ps(delta);
+        __m256 vx = _mm256_cvtph_ps(_mm_load_si128((const __m128i*)(speedX + i)));
+        __m256 vy = _mm256_cvtph_ps(_mm_load_si128((const __m128i*)(speedY + i)));
+        __m256 vz = _mm256_cvtph_ps(_mm_load_si128((const __m128i*)(speedZ + i)));
+        vy = _mm256_add_ps(vy, _mm256_set1_ps(-9.81f * delta * 0.5f));
+        _mm_store_si128((__m128i*)(speedY + i), _mm256_cvtps_ph(vy, _MM_FROUND_TO_NEAREST_INT));
+        uint16_t *pos[3] = { posX, posY, posZ };
+        __m256 v[3] = { vx, vy, vz };
+        for (int k = 0; k < 3; k++)
+        {
+            __m256 p = _mm256_cvtph_ps(_mm_load_si128((const __m128i*)(pos[k] + i)));
+            p = _mm256_add_ps(p, _mm256_mul_ps(v[k], dt));
+            _mm_store_si128((__m128i*)(pos[k] + i), _mm256_cvtps_ph(p, _MM_FROUND_TO_NEAREST_INT));
+        }
+        __m128i dead = _mm_cmpeq_epi16(l, _mm_setzero_si128());
+        return ~(unsigned int)_mm_movemask_epi8(_mm_packs_epi16(dead, _mm_setzero_si128())) & 0xFFu;
+    }
+#else
+    unsigned int integrateBlock(unsigned int i, float delta, uint16_t ticks)
+    {
+        const float gravity = -9.81f * delta * 0.5f;
+        unsigned int alive = 0;
+        for (unsigned int lane = 0; lane < PARTICLE_COMPACT_WIDTH; lane++)
+        {
+            unsigned int p = i + lane;
+            life[p] = life[p] > ticks ? (uint16_t)(life[p] - ticks) : 0;
+            float vy = halfToFloat(speedY[p]) + gravity;
+            speedY[p] = floatToHalf(vy);
+            posX[p] = floatToHalf(halfToFloat(posX[p]) + halfToFloat(speedX[p]) * delta);
+            posY[p] = floatToHalf(halfToFloat(posY[p]) + vy * delta);
+            posZ[p] = floatToHalf(halfToFloat(posZ[p]) + halfToFloat(speedZ[p]) * delta);
+            alive |= (life[p] != 0 ? 1u : 0u) << lane;
+        }
+        return alive;
+    }
+#endif
+};
+#endif
@@ -1,66 +1,234 @@
+#ifndef PARTICLE_CONTAINER_H
+#define PARTICLE_CONTAINER_H
+
 #include <iostream>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <learnopengl/gl_state.h>
 #include <learnopengl/shader_m.h>
 #include <vector>
 
 #include "particle.cpp"
+#include "particle_store.h"
+#include "particle_compact.h"
+#include "particle_cache.h"
+#include "particle_feedback.h"
+#include "particle_fluid.h"
+#include "particle_sort.h"
+#include "particle_random.h"
+
+// where the particles are simulated
+enum ParticleBackend {
+    PARTICLE_BACKEND_CPU, // SoA store + SIMD kernel, instances streamed every frame
+    PARTICLE_BACKEND_GPU  // transform feedback, the state never leaves the GPU
+};
+
+// what to do with a new particle when the pool is full
+enum ParticleOverflow {
+    PARTICLE_OVERFLOW_DROP,          // don't emit it
+    PARTICLE_OVERFLOW_RECYCLE_OLDEST // replace the oldest live particle
+};
+
+// how the CPU backend keeps its particles
+enum ParticleFormat {
+    PARTICLE_FORMAT_FLOAT,  // ParticleStore, full float precision
+    PARTICLE_FORMAT_COMPACT // CompactParticleStore, fp16 / RGBA8 / 16-bit life, ~2.4x smaller
+};
+
+// how the CPU particles move
+enum ParticleDynamics {
+    PARTICLE_DYNAMICS_BALLISTIC, // independent, gravity only
+    PARTICLE_DYNAMICS_SPH        // interacting as a fluid through ParticleFluid, float format only
+};
+
+// world space size of a sprite at full detail
+const float PARTICLE_SPRITE_SIZE = 0.05f;
+
+// how the sprites are composited
+enum ParticleBlend {
+    PARTICLE_BLEND_ALPHA,       // over operator, needs back-to-front order
+    PARTICLE_BLEND_ADDITIVE,    // glow, order independent so sorting is skipped
+    PARTICLE_BLEND_WEIGHTED_OIT // accumulated by WeightedBlendedOIT, which owns the blend state; no sorting
+};
 
 class ParticleContainer {
     public:
-        GLuint nr_particles = 5000;
-        std::vector<Particle> particles;
-        GLuint LastUsedParticle = 0;
-        GLuint VAO;
+        GLuint nr_particles;
+        ParticleBackend backend;
+        ParticleFormat format;
+        ParticleStore particles;        // PARTICLE_FORMAT_FLOAT
+        CompactParticleStore compact;   // PARTICLE_FORMAT_COMPACT
+        ParticleFeedback* feedback;
+        ParticleFluid* fluid;           // PARTICLE_DYNAMICS_SPH, NULL otherwise
+        ParticleCache* playback;        // baked particles drawn instead of simulated ones, NULL otherwise
+        GLuint VAO, quadVBO, instanceVBO;
         Shader shader;
         glm::vec3 posInit;
+        float lifetime = 4.0f; // seconds
+        float spread = 0.2f;
+        ParticleOverflow overflow = PARTICLE_OVERFLOW_RECYCLE_OLDEST;
+        ParticleBlend blend = PARTICLE_BLEND_ALPHA;
+        ParticleSorter sorter;
+        ParticleRandom random; // spawn directions and colors, see the seed argument
+        float boundsRadius = 2.0f; // sphere around posInit used for culling and LOD
+        // level of detail, set every frame by ParticleSystem
+        bool visible = true;
+        float emission = 1.0f;    // fraction of the full emission rate
+        float spriteScale = 1.0f; // grows the sprites as fewer of them are emitted
+        unsigned long long spawned = 0; // particles emitted so far, numbers them for the caches
 
-        ParticleContainer(Shader shader, glm::vec3 posInit) : shader("particle.vs", "particle.fs") {
-            this->shader = shader;
+        // emitters built with the same seed spawn exactly the same particles
+        ParticleContainer(Shader shader, glm::vec3 posInit, GLuint nr_particles = 5000, ParticleBackend backend = PARTICLE_BACKEND_CPU, unsigned int seed = 1,
+                          ParticleFormat format = PARTICLE_FORMAT_FLOAT) : shader(shader), random(seed) {
+            this->setup(posInit, nr_particles, backend, format);
             this->initBuffers();
-            this->posInit = posInit;
-            for (GLuint i = 0; i < this->nr_particles; ++i)
-                this->particles.push_back(Particle());
+            if (backend == PARTICLE_BACKEND_GPU)
+                this->feedback = new ParticleFeedback(nr_particles, this->quadVBO);
         }
 
-        void generateParticles(float delta) {
+        // A CPU emitter without any GL object, for headless runs like particle_bench: it spawns
+        // and simulates like the one above but cannot be drawn.
+        ParticleContainer(glm::vec3 posInit, GLuint nr_particles, unsigned int seed = 1, ParticleFormat format = PARTICLE_FORMAT_FLOAT)
+            : random(seed) {
+            this->setup(posInit, nr_particles, PARTICLE_BACKEND_CPU, format);
+            this->VAO = this->quadVBO = this->instanceVBO = 0;
+        }
+
+        ~ParticleContainer() {
+            delete this->fluid;
+            delete this->playback;
+        }
+
+        // Replaces the simulation by the particles baked in a cache file, looping over it. Only
+        // the CPU backend streams its instances and can play one back.
+        bool playFrom(const std::string &path) {
+            if (this->backend != PARTICLE_BACKEND_CPU) {
+                std::cout << "WARNING::PARTICLES:: cache playback needs the CPU backend, simulating instead" << std::endl;
+                return false;
+            }
+            ParticleCache* cache = new ParticleCache();
+            if (!cache->open(path)) {
+                delete cache;
+                return false;
+            }
+            delete this->playback;
+            this->playback = cache;
+            return true;
+        }
+
+        // moves the play head of a cache being played back
+        void advancePlayback(float delta) {
+            if (this->playback)
+                this->playback->advance(delta);
+        }
+
+        // Bakes the live particles into the cache, call it every frame once they are simulated.
+        // Particles of an emitter all live as long, so the live ones are the last ones spawned.
+        void recordTo(ParticleCacheWriter &writer, float delta) const {
+            if (this->backend != PARTICLE_BACKEND_CPU || this->playback)
+                return;
+            if (this->format == PARTICLE_FORMAT_COMPACT)
+                writer.record(delta, this->compact, this->spawned - this->compact.count);
+            else
+                writer.record(delta, this->particles, this->spawned - this->particles.count);
+        }
+
+        // Switches between ballistic particles and an SPH fluid. Only the CPU backend with
+        // the float format can run the fluid; other emitters stay ballistic.
+        void setDynamics(ParticleDynamics dynamics) {
+            if (dynamics == PARTICLE_DYNAMICS_SPH && (this->backend != PARTICLE_BACKEND_CPU || this->format != PARTICLE_FORMAT_FLOAT)) {
+                std::cout << "WARNING::PARTICLES:: SPH needs the CPU backend and the float format, staying ballistic" << std::endl;
+                return;
+            }
+            if (dynamics == PARTICLE_DYNAMICS_SPH && !this->fluid)
+                this->fluid = new ParticleFluid();
+            if (dynamics == PARTICLE_DYNAMICS_BALLISTIC) {
+                delete this->fluid;
+                this->fluid = NULL;
+            }
+        }
+
+        // Number of particles to emit for a frame of delta seconds at the current emission rate.
+        int emissionCount(float delta) const {
             // Generate 10 new particule each millisecond,
             // but limit this to 16 ms (60 fps), or if you have 1 long frame (1sec),
             // newparticles will be huge and the next frame even longer.
             int newparticles = (int)(delta*this->nr_particles);
 
-            if (newparticles > (int)(0.016f*this->nr_particles)) {
-                newparticles = (int)(0.016f*this->nr_particles);   
+            if (newparticles > this->maxNewParticles()) {
+                newparticles = this->maxNewParticles();
+            }
+            return (int)(newparticles * this->emission);
+        }
+
+        // Upper bound of the particles alive right now. The GPU backend never reads its
+        // state back: it counts what it spawned during the last lifetime instead.
+        unsigned int liveParticles() const {
+            if (this->backend == PARTICLE_BACKEND_GPU) {
+                unsigned int alive = 0;
+                for (int i = 0; i < GPU_LIFE_SLICES; i++)
+                    alive += this->spawnedInSlice[i];
+                return std::min(alive, (unsigned int)this->nr_particles);
+            }
+            if (this->playback)
+                return std::min(this->playback->count(), (unsigned int)this->nr_particles);
+            return this->format == PARTICLE_FORMAT_COMPACT ? this->compact.count : this->particles.count;
+        }
+
+        void generateParticles(int newparticles) {
+            if (this->backend == PARTICLE_BACKEND_GPU) {
+                // the update shader emits them during the next simulation step
+                this->pendingSpawn += newparticles;
+                if (this->pendingSpawn > this->nr_particles)
+                    this->pendingSpawn = this->nr_particles;
+                return;
             }
 
+            // draw the random numbers of the whole batch at once:
+            // <x directions, y directions, z directions, colors>
+            this->randoms.resize(4 * newparticles);
+            GLfloat* randomdirs = this->randoms.data();
+            GLfloat* rColors = randomdirs + 3 * newparticles;
+            this->random.uniform(randomdirs, 3 * newparticles, -1.0f, 1.0f);
+            this->random.uniform(rColors, newparticles, 0.5f, 1.5f);
+
             for(int i=0; i < newparticles; i++){
                 int particleIndex = this->FindUnusedParticle();
-                this->particles[particleIndex].life = 4.0f; // This particle will live 4 seconds.
-                this->particles[particleIndex].pos = this->posInit;
+                if (particleIndex < 0)
+                    break; // pool is full and the overflow policy drops new particles
 
-                float spread = 0.2f;
+                Particle particle;
+                particle.life = this->lifetime; // This particle will live 4 seconds by default.
+                particle.pos = this->posInit;
+
+                float spread = this->spread;
                 glm::vec3 maindir = glm::vec3(0.0f, 1.0f, 0.0f);
 
                 glm::vec3 randomdir = glm::vec3(
-                    (rand()%2000 - 1000.0f)/1000.0f,
-                    (rand()%2000 - 1000.0f)/1000.0f,
-                    (rand()%2000 - 1000.0f)/1000.0f
+                    randomdirs[i],
+                    randomdirs[newparticles + i],
+                    randomdirs[2 * newparticles + i]
                 );
                 
-                this->particles[particleIndex].speed = maindir + randomdir * spread;
+                particle.speed = maindir + randomdir * spread;
+
+                GLfloat rColor = rColors[i];
+                particle.color =  glm::vec4(rColor, rColor, rColor, 1.0f);
 
-                GLfloat rColor = 0.5 + ((rand() % 100) / 100.0f);
-                this->particles[particleIndex].color =  glm::vec4(rColor, rColor, rColor, 1.0f);
+                particle.size = 10.0f;
 
-                this->particles[particleIndex].size = 10.0f;
+                if (this->format == PARTICLE_FORMAT_COMPACT)
+                    this->compact.set(particleIndex, particle.pos, particle.speed, particle.color, particle.life);
+                else
+                    this->particles.set(particleIndex, particle.pos, particle.speed, particle.color, particle.life);
+                this->spawned++;
             }
         }
 
         void initBuffers() {
             // Set up mesh and attribute properties
-            GLuint VBO;
             GLfloat particle_quad[] = {
                 0.0f, 1.0f, 0.0f, 1.0f,
                 1.0f, 0.0f, 1.0f, 0.0f,
@@ -71,92 +239,237 @@ class ParticleContainer {
                 1.0f, 0.0f, 1.0f, 0.0f
             }; 
             glGenVertexArrays(1, &this->VAO);
-            glGenBuffers(1, &VBO);
-            glBindVertexArray(this->VAO);
+            glGenBuffers(1, &this->quadVBO);
+            glGenBuffers(1, &this->instanceVBO);
+            glState().bindVertexArray(this->VAO);
             // Fill mesh buffer
-            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBindBuffer(GL_ARRAY_BUFFER, this->quadVBO);
             glBufferData(GL_ARRAY_BUFFER, sizeof(particle_quad), particle_quad, GL_STATIC_DRAW);
             // Set mesh attributes
             glEnableVertexAttribArray(0);
             glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)0);
-            glBindVertexArray(0);
+            // Per-instance attributes: <vec3 offset, vec4 color>, refilled every frame
+            glBindBuffer(GL_ARRAY_BUFFER, this->instanceVBO);
+            glBufferData(GL_ARRAY_BUFFER, this->instanceBufferSize(), NULL, GL_STREAM_DRAW);
+            glEnableVertexAttribArray(1);
+            glEnableVertexAttribArray(2);
+            if (this->format == PARTICLE_FORMAT_COMPACT) {
+                // CompactParticleInstance: half float offset from the origin, normalized RGBA8 color
+                GLsizei stride = sizeof(CompactParticleInstance);
+                glVertexAttribPointer(1, 3, GL_HALF_FLOAT, GL_FALSE, stride, (GLvoid*)0);
+                glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (GLvoid*)(4 * sizeof(GLushort)));
+            } else {
+                glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, PARTICLE_INSTANCE_FLOATS * sizeof(GLfloat), (GLvoid*)0);
+                glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, PARTICLE_INSTANCE_FLOATS * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
+            }
+            glVertexAttribDivisor(1, 1);
+            glVertexAttribDivisor(2, 1);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glState().bindVertexArray(0);
         }
 
-        // Finds a Particle in particles which isn't used yet.
-        // (i.e. life < 0);
+        // Finds a Particle in particles which isn't used yet, in O(1): live particles are
+        // packed in spawn order, so the free slot is right after them and the oldest one is
+        // at the front. Returns -1 when the pool is full and the overflow policy drops it.
         int FindUnusedParticle(){
+            if (this->format == PARTICLE_FORMAT_COMPACT)
+                return this->findUnusedIn(this->compact);
+            return this->findUnusedIn(this->particles);
+        }
 
-            for(int i=this->LastUsedParticle; i < this->nr_particles; i++){
-                if (this->particles[i].life < 0){
-                    this->LastUsedParticle = i;
-                    return i;
-                }
+        // Returns the number of live particles, estimated by the GPU backend (see liveParticles).
+        int simulateParticles(double delta) {
+            if (this->backend == PARTICLE_BACKEND_GPU) {
+                this->feedback->simulate((float)delta, this->pendingSpawn, this->posInit, this->lifetime, this->spread, this->random.next());
+                this->countGpuSpawn(this->pendingSpawn, (float)delta);
+                this->pendingSpawn = 0;
+                return this->liveParticles();
+            }
+            // Simulate all particles, dead ones are compacted away by the store
+            this->sorted = false;
+            if (this->fluid) {
+                this->fluid->step(this->particles, (float)delta);
+                return this->particles.count;
             }
+            if (this->format == PARTICLE_FORMAT_COMPACT)
+                return this->compact.simulate((float)delta);
+            return this->particles.simulate((float)delta);
+        }
+
+        // Orders the live particles back to front for alpha blending, call it after the
+        // simulation step. The GPU backend never reads its particles back and is drawn unsorted.
+        void sortParticles(const glm::vec3 &cameraPos) {
+            this->sorted = this->backend == PARTICLE_BACKEND_CPU && this->blend == PARTICLE_BLEND_ALPHA && !this->playback;
+            if (this->sorted && this->format == PARTICLE_FORMAT_COMPACT)
+                this->sorter.sort(this->compact, cameraPos);
+            else if (this->sorted)
+                this->sorter.sort(this->particles, cameraPos);
+        }
 
-            for(int i=0; i < this->LastUsedParticle; i++){
-                if (this->particles[i].life < 0){
-                    this->LastUsedParticle = i;
-                    return i;
+        // Streams the live particles into the instance buffer. The old storage is orphaned
+        // first, so the driver hands us fresh memory instead of waiting for the GPU to finish
+        // drawing last frame's particles.
+        void uploadInstances() {
+            glBindBuffer(GL_ARRAY_BUFFER, this->instanceVBO);
+            glBufferData(GL_ARRAY_BUFFER, this->instanceBufferSize(), NULL, GL_STREAM_DRAW);
+            GLuint count = this->liveParticles();
+            if (count > 0) {
+                GLsizeiptr bytes = (GLsizeiptr)count * this->instanceSize();
+                void* data = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+                if (data) {
+                    if (this->playback && this->format == PARTICLE_FORMAT_COMPACT)
+                        this->playback->unpack((CompactParticleInstance*)data, count, this->posInit);
+                    else if (this->playback)
+                        this->playback->unpack((GLfloat*)data, count);
+                    else if (this->format == PARTICLE_FORMAT_COMPACT)
+                        this->packInstancesOf(this->compact, (CompactParticleInstance*)data);
+                    else
+                        this->packInstancesOf(this->particles, (GLfloat*)data);
+                    glUnmapBuffer(GL_ARRAY_BUFFER);
                 }
             }
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
 
-            return 0; // All particles are taken, override the first one
+        void draw(unsigned int Texture, glm::mat4 proj, glm::mat4 view) {
+            // the program may still be compiling, the fountains show up once it is linked
+            if (!this->shader.ready())
+                return;
+            GLuint vao = this->VAO;
+            GLuint instances = this->liveParticles();
+            if (this->backend == PARTICLE_BACKEND_GPU) {
+                // draw every slot straight from the state buffer, dead ones are culled in particle.vs
+                vao = this->feedback->renderVAOForDraw();
+                instances = this->nr_particles;
+            } else {
+                this->uploadInstances();
+            }
+            if (instances == 0)
+                return;
+
+            bool weighted = this->blend == PARTICLE_BLEND_WEIGHTED_OIT;
+            if (!weighted) {
+                // the alpha channel accumulates coverage so an OffscreenParticles target ends up
+                // premultiplied, on the screen it is never read
+                glState().enable(GL_BLEND);
+                if (this->blend == PARTICLE_BLEND_ADDITIVE)
+                    glState().blendFuncSeparate(GL_SRC_ALPHA, GL_ONE, GL_ZERO, GL_ONE); // additive blending gives it a 'glow' effect
+                else
+                    glState().blendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            }
+            this->shader.use();
+            this->shader.setBool("weightedOIT", weighted);
+            this->shader.setMat4("projection", proj);
+            this->shader.setMat4("view", view);
+            this->shader.setFloat("scale", PARTICLE_SPRITE_SIZE * this->spriteScale);
+            // compact instances are offsets from the emitter and colors scaled to fit RGBA8
+            bool compact = this->backend == PARTICLE_BACKEND_CPU && this->format == PARTICLE_FORMAT_COMPACT;
+            this->shader.setVec3("origin", compact ? this->posInit : glm::vec3(0.0f));
+            this->shader.setFloat("colorScale", compact ? PARTICLE_COLOR_RANGE : 1.0f);
+            this->shader.setInt("sprite", 0);
+            glState().activeTexture(GL_TEXTURE0);
+            glState().bindTexture(GL_TEXTURE_2D, Texture);
+            // one draw call for the whole container
+            glState().bindVertexArray(vao);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 6, instances);
+            glState().bindVertexArray(0);
+            // Don't forget to reset to default blending mode
+            if (!weighted)
+                glState().blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         }
 
-        int simulateParticles(double delta) {
-            // Simulate all particles
-            int ParticlesCount = 0;
-            for(int i=0; i < this->nr_particles; i++){
+        void deleteBuffers() {
+            // Cleanup VAO and VBOs
+            glDeleteVertexArrays(1, &this->VAO);
+            glDeleteBuffers(1, &this->quadVBO);
+            glDeleteBuffers(1, &this->instanceVBO);
+            if (this->feedback) {
+                this->feedback->deleteBuffers();
+                delete this->feedback;
+                this->feedback = NULL;
+            }
+        }
 
-                Particle& p = this->particles[i]; // shortcut
+    private:
+        GLuint pendingSpawn;
+        // GPU particles all live `lifetime` seconds, so the ones spawned during the last
+        // lifetime are the live ones: counted per slice of it, the oldest slice dropped first
+        static const int GPU_LIFE_SLICES = 32;
+        unsigned int spawnedInSlice[GPU_LIFE_SLICES];
+        int currentSlice;
+        float sliceTime;
+        bool sorted; // sorter.order matches the current particles
+        std::vector<GLfloat> randoms; // generateParticles scratch, kept to avoid per-frame allocations
 
-                if(p.life > 0.0f){
+        void setup(glm::vec3 posInit, GLuint nr_particles, ParticleBackend backend, ParticleFormat format) {
+            this->posInit = posInit;
+            this->nr_particles = nr_particles;
+            this->backend = backend;
+            this->format = format;
+            this->feedback = NULL;
+            this->fluid = NULL;
+            this->playback = NULL;
+            this->pendingSpawn = 0;
+            for (int i = 0; i < GPU_LIFE_SLICES; i++)
+                this->spawnedInSlice[i] = 0;
+            this->currentSlice = 0;
+            this->sliceTime = 0.0f;
+            this->sorted = false;
+            if (backend == PARTICLE_BACKEND_CPU && format == PARTICLE_FORMAT_FLOAT)
+                this->particles.allocate(nr_particles, this->maxNewParticles());
+            if (backend == PARTICLE_BACKEND_CPU && format == PARTICLE_FORMAT_COMPACT) {
+                this->compact.allocate(nr_particles, this->maxNewParticles());
+                this->compact.origin = posInit;
+            }
+        }
 
-                    // Decrease life
-                    p.life -= delta;
-                    if (p.life > 0.0f){
+        // limit emission to 16 ms worth of particles per frame
+        int maxNewParticles() const {
+            return (int)(0.016f*this->nr_particles);
+        }
 
-                        // Simulate simple physics : gravity only, no collisions
-                        p.speed += glm::vec3(0.0f,-9.81f, 0.0f) * (float)delta * 0.5f;
-                        p.pos += p.speed * (float)delta;
-                        // p.color.a -= delta * 2.5;
-                    }
 
-                    ParticlesCount++;
+        // bytes of one instance record
+        GLsizeiptr instanceSize() const {
+            if (this->format == PARTICLE_FORMAT_COMPACT)
+                return sizeof(CompactParticleInstance);
+            return PARTICLE_INSTANCE_FLOATS * sizeof(GLfloat);
+        }
 
-                }
-            }
+        GLsizeiptr instanceBufferSize() const {
+            // the GPU backend draws from its own state buffers
+            if (this->backend == PARTICLE_BACKEND_GPU)
+                return 0;
+            return (GLsizeiptr)this->nr_particles * this->instanceSize();
+        }
 
-            return ParticlesCount;
+        // records the particles the update shader was asked to emit this step
+        void countGpuSpawn(unsigned int spawned, float delta) {
+            this->spawnedInSlice[this->currentSlice] += spawned;
+            float slice = this->lifetime / GPU_LIFE_SLICES;
+            for (this->sliceTime += delta; slice > 0.0f && this->sliceTime >= slice; this->sliceTime -= slice) {
+                this->currentSlice = (this->currentSlice + 1) % GPU_LIFE_SLICES;
+                this->spawnedInSlice[this->currentSlice] = 0;
+            }
         }
 
-        void draw(unsigned int Texture, glm::mat4 proj, glm::mat4 view) {
-           // Use additive blending to give it a 'glow' effect
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            this->shader.use();
-            for (Particle particle : this->particles)
-            {
-                if (particle.life > 0.0f)
-                {
-                    this->shader.setVec3("offset", particle.pos);
-                    this->shader.setVec4("color", particle.color);
-                    this->shader.setMat4("projection", proj);
-                    this->shader.setMat4("view", view);
-                    this->shader.setInt("sprite", 0);
-                    glActiveTexture(GL_TEXTURE0);
-                    glBindTexture(GL_TEXTURE_2D, Texture);
-                    glBindVertexArray(this->VAO);
-                    glDrawArrays(GL_TRIANGLES, 0, 6);
-                    glBindVertexArray(0);
-                }
+        // FindUnusedParticle() for either store format
+        template <class Store>
+        int findUnusedIn(Store &store) {
+            if (store.count == store.capacity) {
+                if (this->overflow == PARTICLE_OVERFLOW_DROP)
+                    return -1;
+                store.retireOldest();
             }
-            // Don't forget to reset to default blending mode
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            return store.push();
         }
 
-        void deleteBuffers() {
-            // Cleanup VBO and shader
-            glDeleteBuffers(1, &this->VAO);
+        template <class Store, class Instance>
+        void packInstancesOf(const Store &store, Instance *data) const {
+            if (this->sorted)
+                store.packInstances(data, this->sorter.order.data(), store.count);
+            else
+                store.packInstances(data, store.first, store.count);
         }
-};
\ No newline at end of file
+};
+#endif
@@ -0,0 +1,16 @@
+#version 330 core
+
+uniform sampler2D sceneDepth; // full resolution
+uniform int factor;
+
+// farthest depth of the factor x factor block under this low resolution pixel
+void main()
+{
+    ivec2 last = textureSize(sceneDepth, 0) - 1;
+    ivec2 base = ivec2(gl_FragCoord.xy) * factor;
+    float depth = 0.0;
+    for (int y = 0; y < factor; y++)
+        for (int x = 0; x < factor; x++)
+            depth = max(depth, texelFetch(sceneDepth, min(base + ivec2(x, y), last), 0).r);
+    gl_FragDepth = depth;
+}
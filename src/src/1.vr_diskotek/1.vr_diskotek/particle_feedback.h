@@ -0,0 +1,117 @@
+#ifndef PARTICLE_FEEDBACK_H
+#define PARTICLE_FEEDBACK_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader_m.h>
+
+#include <string>
+#include <vector>
+
+// floats per particle in a GPU state buffer: <vec4 posLife, vec4 speed, vec4 color>
+const unsigned int PARTICLE_STATE_FLOATS = 12;
+
+// GPU-resident particle simulation. The particle state lives in two VBOs that are
+// ping-ponged every frame: particle_update.vs reads one and writes the other through
+// transform feedback, so only the emitter parameters cross the bus.
+class ParticleFeedback
+{
+public:
+    Shader updateShader;
+    GLuint capacity;
+
+    // quadVBO holds the sprite quad used by the render VAOs (attribute 0)
+    ParticleFeedback(GLuint capacity, GLuint quadVBO)
+        : updateShader("particle_update.vs", std::vector<std::string>{ "outPosLife", "outSpeed", "outColor" }),
+          capacity(capacity), current(0), spawnStart(0)
+    {
+        // all particles start dead: life = 0
+        std::vector<GLfloat> zero((size_t)capacity * PARTICLE_STATE_FLOATS, 0.0f);
+        glGenBuffers(2, this->stateVBO);
+        glGenVertexArrays(2, this->updateVAO);
+        glGenVertexArrays(2, this->renderVAO);
+        GLsizei stride = PARTICLE_STATE_FLOATS * sizeof(GLfloat);
+        for (int i = 0; i < 2; i++)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, this->stateVBO[i]);
+            glBufferData(GL_ARRAY_BUFFER, zero.size() * sizeof(GLfloat), zero.data(), GL_DYNAMIC_COPY);
+
+            // update: the whole state as per-vertex input
+            glState().bindVertexArray(this->updateVAO[i]);
+            for (GLuint a = 0; a < 3; a++)
+            {
+                glEnableVertexAttribArray(a);
+                glVertexAttribPointer(a, 4, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(a * 4 * sizeof(GLfloat)));
+            }
+
+            // render: the sprite quad plus position and color as per-instance input, matching particle.vs
+            glState().bindVertexArray(this->renderVAO[i]);
+            glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)0);
+            glBindBuffer(GL_ARRAY_BUFFER, this->stateVBO[i]);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)0);
+            glVertexAttribDivisor(1, 1);
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(8 * sizeof(GLfloat)));
+            glVertexAttribDivisor(2, 1);
+        }
+        glState().bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Advances every particle by delta seconds and respawns up to spawnCount dead ones at origin.
+    // seed drives the spawn randomness, a fresh one per frame keeps the particles apart.
+    void simulate(float delta, GLuint spawnCount, const glm::vec3 &origin, float lifetime, float spread, GLuint seed)
+    {
+        int next = 1 - this->current;
+
+        this->updateShader.use();
+        this->updateShader.setFloat("delta", delta);
+        this->updateShader.setVec3("origin", origin);
+        this->updateShader.setFloat("lifetime", lifetime);
+        this->updateShader.setFloat("spread", spread);
+        this->updateShader.setUint("spawnStart", this->spawnStart);
+        this->updateShader.setUint("spawnCount", spawnCount);
+        this->updateShader.setUint("capacity", this->capacity);
+        this->updateShader.setUint("seed", seed);
+
+        glState().enable(GL_RASTERIZER_DISCARD);
+        glState().bindVertexArray(this->updateVAO[this->current]);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, this->stateVBO[next]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, this->capacity);
+        glEndTransformFeedback();
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glState().bindVertexArray(0);
+        glState().disable(GL_RASTERIZER_DISCARD);
+
+        // the spawn window walks around the pool like a ring
+        this->spawnStart = (this->spawnStart + spawnCount) % this->capacity;
+        this->current = next;
+    }
+
+    // VAO that draws the latest state with particle.vs, one instance per slot
+    GLuint renderVAOForDraw() const
+    {
+        return this->renderVAO[this->current];
+    }
+
+    void deleteBuffers()
+    {
+        glDeleteVertexArrays(2, this->updateVAO);
+        glDeleteVertexArrays(2, this->renderVAO);
+        glDeleteBuffers(2, this->stateVBO);
+        glDeleteProgram(this->updateShader.ID);
+    }
+
+private:
+    GLuint stateVBO[2];
+    GLuint updateVAO[2];
+    GLuint renderVAO[2];
+    int current;
+    GLuint spawnStart;
+};
+#endif
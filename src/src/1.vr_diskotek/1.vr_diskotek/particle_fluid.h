@@ -0,0 +1,421 @@
+#ifndef PARTICLE_FLUID_H
+#define PARTICLE_FLUID_H
+
+#include <glm/glm.hpp>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include "particle_store.h"
+
+// particles handled by one job of the density and force passes
+const unsigned int PARTICLE_FLUID_CHUNK_SIZE = 4096;
+
+// what the last ParticleFluid step did and how long it took
+struct ParticleFluidStats {
+    unsigned int particles;    // live particles stepped
+    unsigned int substeps;
+    double gridSeconds;        // rebuilding the hash grid, summed over the substeps
+    double neighborSeconds;    // density and force passes walking the neighbors
+    double stepSeconds;        // wall clock of the whole step
+    double averageNeighbors;   // per particle, itself included
+    double particlesPerSecond; // live particles / stepSeconds
+};
+
+// Smoothed particle hydrodynamics for a ParticleStore (Müller et al. 2003): a poly6 density,
+// spiky pressure gradient and viscosity Laplacian, integrated with symplectic Euler in
+// substeps short enough to stay stable.
+//
+// Neighbors are found through a uniform grid of smoothingRadius cells hashed into a table of
+// at least twice the capacity. The hash wraps the cell coordinates into a power of two box
+// (64^3 cells for 100k particles), so cells that are neighbors in x are neighboring buckets and
+// each row of three cells is one contiguous run of the sorted streams; cells a whole box apart
+// share buckets and are told apart by the distance test. The grid is rebuilt every substep
+// with a counting sort: the live range is cut
+// into one slice per thread, every slice counts its particles per bucket, one scan turns the
+// counts into per slice offsets, and the slices then scatter positions and velocities bucket
+// by bucket into sorted streams. The density and force passes only read those sorted streams,
+// in PARTICLE_FLUID_CHUNK_SIZE chunks, and write the results back to the store's slots, so the
+// store keeps its spawn order and every pass runs on the workers without locks.
+class ParticleFluid
+{
+public:
+    float smoothingRadius; // h, also the grid cell size
+    float restDensity;
+    float particleMass;
+    float stiffness;       // pressure = stiffness * (density - restDensity), never negative
+    float viscosity;
+    float maxAcceleration; // of the fluid forces, keeps freshly emitted clusters from exploding
+    float maxSubstep;      // seconds
+    glm::vec3 gravity;
+    float floorHeight;     // particles bounce off this plane
+    float restitution;
+    ParticleFluidStats stats;
+
+    ParticleFluid()
+        : smoothingRadius(0.1f), restDensity(1000.0f), stiffness(20.0f), viscosity(0.5f), maxAcceleration(200.0f),
+          maxSubstep(1.0f / 120.0f), gravity(0.0f, -9.81f * 0.5f, 0.0f), floorHeight(-2.0f), restitution(0.3f),
+          store(NULL), pool(NULL), buckets(0), xMask(0), yMask(0), zMask(0), yShift(0), zShift(0), slices(0), chunks(0), substep(0), substeps(0), dt(0.0f), invCellSize(0.0f), remaining(0), neighborPairs(0)
+    {
+        // rest spacing of half the smoothing radius
+        float spacing = this->smoothingRadius * 0.5f;
+        this->particleMass = this->restDensity * spacing * spacing * spacing;
+        memset(&this->stats, 0, sizeof(this->stats));
+    }
+
+    // Advances the live particles by delta seconds on the calling thread and removes the dead ones.
+    void step(ParticleStore &particles, float delta)
+    {
+        this->start(particles, delta, NULL, std::function<void()>());
+    }
+
+    // Same step on the pool: the passes are queued as jobs and each pass is queued by the last
+    // job of the previous one, so this returns right away. done runs on the worker that
+    // finishes the step, after the dead particles are removed.
+    void schedule(ThreadPool &pool, ParticleStore &particles, float delta, const std::function<void()> &done)
+    {
+        this->start(particles, delta, &pool, done);
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    typedef void (ParticleFluid::*Job)(unsigned int);
+    typedef void (ParticleFluid::*Next)();
+
+    ParticleStore *store;
+    ThreadPool *pool;
+    std::function<void()> done;
+    unsigned int buckets;  // hash table size, a power of two
+    unsigned int xMask, yMask, zMask, yShift, zShift; // of the wrapped cell coordinates in a bucket
+    unsigned int slices;   // of the counting sort
+    unsigned int chunks;   // of the neighbor passes
+    unsigned int substep, substeps;
+    float dt;
+    float invCellSize;
+    std::atomic<unsigned int> remaining; // jobs of the current pass still running
+    std::atomic<unsigned long> neighborPairs;
+    Clock::time_point stepStart, passStart;
+
+    // per live particle, in storage order
+    std::vector<unsigned int> keys;
+    // per slice and bucket: counts, then write offsets
+    std::vector<unsigned int> offsets;
+    // first sorted particle of every bucket, plus the end
+    std::vector<unsigned int> cellStart;
+    // sorted by bucket
+    std::vector<float> x, y, z, vx, vy, vz, density, pressure;
+    std::vector<unsigned int> slot;
+
+    void start(ParticleStore &particles, float delta, ThreadPool *pool, const std::function<void()> &done)
+    {
+        this->stepStart = Clock::now();
+        this->store = &particles;
+        this->pool = pool;
+        this->done = done;
+        this->stats.gridSeconds = this->stats.neighborSeconds = 0.0;
+        this->neighborPairs = 0;
+        this->substeps = std::max(1u, (unsigned int)std::ceil(delta / this->maxSubstep));
+        this->dt = delta / this->substeps;
+        this->substep = 0;
+        this->invCellSize = 1.0f / this->smoothingRadius;
+
+        unsigned int n = particles.count;
+        this->chunks = (n + PARTICLE_FLUID_CHUNK_SIZE - 1) / PARTICLE_FLUID_CHUNK_SIZE;
+        this->slices = std::min(pool ? pool->size() + 1 : 1u, this->chunks);
+        if (n == 0) {
+            this->substeps = 0;
+            this->finish();
+            return;
+        }
+
+        // grown only, so a running emitter never allocates
+        unsigned int bits = 6; // at least 4^3 buckets, so the 27 cells around one never share a bucket
+        while ((1u << bits) < 2 * particles.capacity)
+            bits++;
+        unsigned int buckets = 1u << bits;
+        unsigned int xBits = (bits + 2) / 3, yBits = (bits + 1) / 3, zBits = bits / 3;
+        this->buckets = buckets;
+        this->xMask = (1u << xBits) - 1;
+        this->yMask = (1u << yBits) - 1;
+        this->zMask = (1u << zBits) - 1;
+        this->yShift = xBits;
+        this->zShift = xBits + yBits;
+        if (this->keys.size() < particles.capacity) {
+            std::vector<float>* streams[8] = { &this->x, &this->y, &this->z, &this->vx, &this->vy, &this->vz, &this->density, &this->pressure };
+            for (unsigned int s = 0; s < 8; s++)
+                streams[s]->resize(particles.capacity);
+            this->slot.resize(particles.capacity);
+            this->keys.resize(particles.capacity);
+        }
+        if (this->cellStart.size() < (size_t)buckets + 1)
+            this->cellStart.resize((size_t)buckets + 1);
+        if (this->offsets.size() < (size_t)buckets * this->slices)
+            this->offsets.resize((size_t)buckets * this->slices);
+
+        this->startSubstep();
+    }
+
+    // runs job(0 .. jobs-1), then next; inline without a pool, otherwise the last job queues next
+    void run(unsigned int jobs, Job job, Next next)
+    {
+        if (!this->pool) {
+            for (unsigned int j = 0; j < jobs; j++)
+                (this->*job)(j);
+            (this->*next)();
+            return;
+        }
+        this->remaining = jobs;
+        for (unsigned int j = 0; j < jobs; j++) {
+            this->pool->submit([this, j, job, next] {
+                (this->*job)(j);
+                if (this->remaining.fetch_sub(1) == 1)
+                    (this->*next)();
+            });
+        }
+    }
+
+    void startSubstep()
+    {
+        this->passStart = Clock::now();
+        this->run(this->slices, &ParticleFluid::countSlice, &ParticleFluid::scan);
+    }
+
+    void scan()
+    {
+        unsigned int running = 0;
+        for (unsigned int b = 0; b < this->buckets; b++) {
+            this->cellStart[b] = running;
+            for (unsigned int s = 0; s < this->slices; s++) {
+                unsigned int &offset = this->offsets[(size_t)s * this->buckets + b];
+                unsigned int count = offset;
+                offset = running;
+                running += count;
+            }
+        }
+        this->cellStart[this->buckets] = running;
+        this->run(this->slices, &ParticleFluid::scatterSlice, &ParticleFluid::gridBuilt);
+    }
+
+    void gridBuilt()
+    {
+        Clock::time_point now = Clock::now();
+        this->stats.gridSeconds += std::chrono::duration<double>(now - this->passStart).count();
+        this->passStart = now;
+        this->run(this->chunks, &ParticleFluid::densityChunk, &ParticleFluid::densityDone);
+    }
+
+    void densityDone()
+    {
+        this->run(this->chunks, &ParticleFluid::forceChunk, &ParticleFluid::substepDone);
+    }
+
+    void substepDone()
+    {
+        this->stats.neighborSeconds += std::chrono::duration<double>(Clock::now() - this->passStart).count();
+        if (++this->substep < this->substeps)
+            this->startSubstep();
+        else
+            this->finish();
+    }
+
+    void finish()
+    {
+        unsigned int stepped = this->store->count;
+        this->store->removeDead();
+        this->stats.particles = stepped;
+        this->stats.substeps = this->substeps;
+        this->stats.stepSeconds = std::chrono::duration<double>(Clock::now() - this->stepStart).count();
+        this->stats.averageNeighbors = stepped && this->substeps ? (double)this->neighborPairs / ((double)stepped * this->substeps) : 0.0;
+        this->stats.particlesPerSecond = this->stats.stepSeconds > 0.0 ? stepped / this->stats.stepSeconds : 0.0;
+        if (this->done)
+            this->done();
+    }
+
+    // ------------------------------------------------------------------------
+    // hash grid
+
+    int cell(float v) const
+    {
+        return (int)std::floor(v * this->invCellSize);
+    }
+
+    unsigned int bucket(int cx, int cy, int cz) const
+    {
+        return (((unsigned int)cz & this->zMask) << this->zShift) | (((unsigned int)cy & this->yMask) << this->yShift) | ((unsigned int)cx & this->xMask);
+    }
+
+    // live particles [begin, end) of slice s, relative to store->first
+    void sliceRange(unsigned int s, unsigned int &begin, unsigned int &end) const
+    {
+        unsigned int n = this->store->count;
+        begin = (unsigned int)((unsigned long long)n * s / this->slices);
+        end = (unsigned int)((unsigned long long)n * (s + 1) / this->slices);
+    }
+
+    void countSlice(unsigned int s)
+    {
+        const ParticleStore &p = *this->store;
+        unsigned int *counts = &this->offsets[(size_t)s * this->buckets];
+        memset(counts, 0, this->buckets * sizeof(unsigned int));
+        unsigned int begin, end;
+        this->sliceRange(s, begin, end);
+        for (unsigned int i = begin; i < end; i++) {
+            unsigned int k = p.first + i;
+            unsigned int key = this->bucket(this->cell(p.posX[k]), this->cell(p.posY[k]), this->cell(p.posZ[k]));
+            this->keys[i] = key;
+            counts[key]++;
+        }
+    }
+
+    void scatterSlice(unsigned int s)
+    {
+        const ParticleStore &p = *this->store;
+        unsigned int *offsets = &this->offsets[(size_t)s * this->buckets];
+        unsigned int begin, end;
+        this->sliceRange(s, begin, end);
+        for (unsigned int i = begin; i < end; i++) {
+            unsigned int k = p.first + i;
+            unsigned int d = offsets[this->keys[i]]++;
+            this->x[d] = p.posX[k];    this->y[d] = p.posY[k];    this->z[d] = p.posZ[k];
+            this->vx[d] = p.speedX[k]; this->vy[d] = p.speedY[k]; this->vz[d] = p.speedZ[k];
+            this->slot[d] = k;
+        }
+    }
+
+    // The runs of sorted particles in the 27 cells around a grid cell, empty ones left out.
+    // Consecutive sorted particles mostly share their cell, so a pass keeps the last one and
+    // only rebuilds it when the cell changes.
+    struct Neighborhood {
+        int cx, cy, cz;
+        unsigned int nrRuns;
+        unsigned int begin[27], end[27];
+
+        Neighborhood() : cx(0), cy(0), cz(0), nrRuns(~0u) { }
+
+        void add(unsigned int first, unsigned int last)
+        {
+            if (first == last)
+                return;
+            this->begin[this->nrRuns] = first;
+            this->end[this->nrRuns++] = last;
+        }
+    };
+
+    // Calls visit(k, dx, dy, dz, r2) for every sorted particle k within smoothingRadius of
+    // sorted particle j, itself included.
+    template <class Visit>
+    void forEachNeighbor(unsigned int j, Neighborhood &around, Visit visit) const
+    {
+        const float h2 = this->smoothingRadius * this->smoothingRadius;
+        const float xj = this->x[j], yj = this->y[j], zj = this->z[j];
+        int cx = this->cell(xj), cy = this->cell(yj), cz = this->cell(zj);
+        if (around.nrRuns == ~0u || cx != around.cx || cy != around.cy || cz != around.cz) {
+            around.cx = cx; around.cy = cy; around.cz = cz;
+            around.nrRuns = 0;
+            unsigned int left = (unsigned int)(cx - 1) & this->xMask;
+            for (int dz = -1; dz <= 1; dz++)
+            for (int dy = -1; dy <= 1; dy++) {
+                unsigned int row = this->bucket(0, cy + dy, cz + dz);
+                if (left + 2 <= this->xMask) {
+                    around.add(this->cellStart[row + left], this->cellStart[row + left + 3]);
+                    continue;
+                }
+                // the row wraps around the box
+                for (unsigned int dx = 0; dx < 3; dx++) {
+                    unsigned int b = row + ((left + dx) & this->xMask);
+                    around.add(this->cellStart[b], this->cellStart[b + 1]);
+                }
+            }
+        }
+        for (unsigned int i = 0; i < around.nrRuns; i++) {
+            for (unsigned int k = around.begin[i]; k < around.end[i]; k++) {
+                float rx = xj - this->x[k];
+                float ry = yj - this->y[k];
+                float rz = zj - this->z[k];
+                float r2 = rx * rx + ry * ry + rz * rz;
+                if (r2 < h2)
+                    visit(k, rx, ry, rz, r2);
+            }
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // SPH passes over the sorted particles
+
+    void densityChunk(unsigned int c)
+    {
+        const float h = this->smoothingRadius;
+        const float h2 = h * h;
+        const float poly6 = this->particleMass * 315.0f / (64.0f * 3.14159265f * std::pow(h, 9.0f));
+        unsigned int begin = c * PARTICLE_FLUID_CHUNK_SIZE;
+        unsigned int end = std::min(begin + PARTICLE_FLUID_CHUNK_SIZE, this->store->count);
+        unsigned long pairs = 0;
+        Neighborhood around;
+        for (unsigned int j = begin; j < end; j++) {
+            float sum = 0.0f;
+            this->forEachNeighbor(j, around, [&](unsigned int, float, float, float, float r2) {
+                float d = h2 - r2;
+                sum += d * d * d;
+                pairs++;
+            });
+            float rho = sum * poly6;
+            this->density[j] = rho;
+            this->pressure[j] = std::max(this->stiffness * (rho - this->restDensity), 0.0f);
+        }
+        this->neighborPairs += pairs;
+    }
+
+    void forceChunk(unsigned int c)
+    {
+        const float h = this->smoothingRadius;
+        const float spiky = 45.0f / (3.14159265f * std::pow(h, 6.0f)); // also the viscosity Laplacian's constant
+        const float dt = this->dt;
+        ParticleStore &p = *this->store;
+        unsigned int begin = c * PARTICLE_FLUID_CHUNK_SIZE;
+        unsigned int end = std::min(begin + PARTICLE_FLUID_CHUNK_SIZE, p.count);
+        Neighborhood around;
+        for (unsigned int j = begin; j < end; j++) {
+            glm::vec3 pressureForce(0.0f), viscosityForce(0.0f);
+            const float pj = this->pressure[j];
+            this->forEachNeighbor(j, around, [&](unsigned int k, float rx, float ry, float rz, float r2) {
+                if (r2 < 1e-12f)
+                    return; // itself, or a particle emitted at the same spot: no direction
+                float r = std::sqrt(r2);
+                float hr = h - r;
+                float invDensity = 1.0f / this->density[k];
+                // -grad W_spiky points away from k
+                float push = (pj + this->pressure[k]) * 0.5f * invDensity * hr * hr / r;
+                pressureForce += glm::vec3(rx, ry, rz) * push;
+                viscosityForce += glm::vec3(this->vx[k] - this->vx[j], this->vy[k] - this->vy[j], this->vz[k] - this->vz[j]) * (invDensity * hr);
+            });
+            glm::vec3 acceleration = (pressureForce + viscosityForce * this->viscosity) * (spiky * this->particleMass / this->density[j]);
+            float magnitude = glm::length(acceleration);
+            if (magnitude > this->maxAcceleration)
+                acceleration *= this->maxAcceleration / magnitude;
+
+            glm::vec3 v = glm::vec3(this->vx[j], this->vy[j], this->vz[j]) + (acceleration + this->gravity) * dt;
+            glm::vec3 pos = glm::vec3(this->x[j], this->y[j], this->z[j]) + v * dt;
+            if (pos.y < this->floorHeight) {
+                pos.y = this->floorHeight;
+                if (v.y < 0.0f)
+                    v.y = -v.y * this->restitution;
+            }
+
+            unsigned int k = this->slot[j];
+            p.posX[k] = pos.x;   p.posY[k] = pos.y;   p.posZ[k] = pos.z;
+            p.speedX[k] = v.x;   p.speedY[k] = v.y;   p.speedZ[k] = v.z;
+            p.life[k] -= dt;
+        }
+    }
+
+    // not copyable: jobs in flight point back at it
+    ParticleFluid(const ParticleFluid&);
+    ParticleFluid& operator=(const ParticleFluid&);
+};
+#endif
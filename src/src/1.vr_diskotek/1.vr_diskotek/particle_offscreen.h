@@ -0,0 +1,175 @@
+#ifndef PARTICLE_OFFSCREEN_H
+#define PARTICLE_OFFSCREEN_H
+
+#include <glad/glad.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader_m.h>
+
+#include <iostream>
+
+// resolution the particles are shaded at, the value divides both screen dimensions
+enum ParticleResolution {
+    PARTICLE_RESOLUTION_FULL = 1,   // straight into the screen
+    PARTICLE_RESOLUTION_HALF = 2,   // 1/4 of the fragments
+    PARTICLE_RESOLUTION_QUARTER = 4 // 1/16 of the fragments
+};
+
+// Off-screen particles: the sprites are shaded into a low resolution color target and
+// upsampled over the screen afterwards, which divides their fill cost by factor^2.
+//
+// begin() copies the scene depth and reduces every factor x factor block to its farthest depth,
+// so the sprites are never hidden by a foreground edge that only covers part of a block. The
+// sprites are then drawn against that depth into a cleared premultiplied target (the containers'
+// blend functions keep the coverage in alpha). resolve() blends the target over the screen with
+// a nearest-depth upsample: where the full resolution depth is close to all the low resolution
+// neighbours the color is filtered bilinearly, across a depth edge the neighbour whose depth
+// matches the pixel best is taken instead, so the particles don't bleed over the silhouettes.
+class OffscreenParticles
+{
+public:
+    unsigned int width, height; // of the screen
+    unsigned int factor;
+    float nearPlane, farPlane;  // of the projection the scene depth was drawn with
+    float depthThreshold;       // relative linear depth difference treated as an edge
+
+    OffscreenParticles(unsigned int width, unsigned int height, ParticleResolution resolution, float nearPlane, float farPlane)
+        : width(width), height(height), factor(resolution), nearPlane(nearPlane), farPlane(farPlane), depthThreshold(0.1f),
+          downsample("fullscreen.vs", "particle_depth_downsample.fs"), upsample("fullscreen.vs", "particle_upsample.fs")
+    {
+        this->lowWidth = (width + this->factor - 1) / this->factor;
+        this->lowHeight = (height + this->factor - 1) / this->factor;
+
+        // full resolution copy of the scene depth, same format as the default framebuffer's
+        glGenFramebuffers(1, &this->sceneDepthFBO);
+        glState().bindFramebuffer(GL_FRAMEBUFFER, this->sceneDepthFBO);
+        this->sceneDepth = this->createTexture(width, height, GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, this->sceneDepth, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        this->checkStatus();
+
+        // low resolution particle color and downsampled depth
+        glGenFramebuffers(1, &this->FBO);
+        glState().bindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+        this->colorTexture = this->createTexture(this->lowWidth, this->lowHeight, GL_RGBA16F, GL_RGBA, GL_FLOAT);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->colorTexture, 0);
+        this->depthTexture = this->createTexture(this->lowWidth, this->lowHeight, GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->depthTexture, 0);
+        this->checkStatus();
+        glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glGenVertexArrays(1, &this->emptyVAO);
+        this->downsample.use();
+        this->downsample.setInt("sceneDepth", 0);
+        this->upsample.use();
+        this->upsample.setInt("particleColor", 0);
+        this->upsample.setInt("particleDepth", 1);
+        this->upsample.setInt("sceneDepth", 2);
+    }
+
+    // Builds the low resolution depth from the screen and binds the cleared particle target with
+    // a matching viewport. Draw the particles with their usual blending, then call resolve().
+    void begin()
+    {
+        glGetIntegerv(GL_VIEWPORT, this->viewport);
+        glState().bindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glState().bindFramebuffer(GL_DRAW_FRAMEBUFFER, this->sceneDepthFBO);
+        glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, this->width, this->height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        glState().bindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+        glState().viewport(this->viewport[0] / (GLint)this->factor, this->viewport[1] / (GLint)this->factor,
+                   this->viewport[2] / (GLint)this->factor, this->viewport[3] / (GLint)this->factor);
+
+        // farthest depth of every block, written through gl_FragDepth
+        glState().enable(GL_DEPTH_TEST);
+        glState().depthFunc(GL_ALWAYS);
+        glState().depthMask(GL_TRUE);
+        glState().colorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glState().disable(GL_BLEND);
+        this->downsample.use();
+        this->downsample.setInt("factor", this->factor);
+        glState().activeTexture(GL_TEXTURE0);
+        glState().bindTexture(GL_TEXTURE_2D, this->sceneDepth);
+        glState().bindVertexArray(this->emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glState().bindVertexArray(0);
+        glState().colorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glState().depthFunc(GL_LESS);
+
+        const GLfloat transparent[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        glClearBufferfv(GL_COLOR, 0, transparent);
+        // the sprites are tested against the downsampled depth but must not change it
+        glState().depthMask(GL_FALSE);
+    }
+
+    // Upsamples the particles over the screen and restores the viewport and the default state.
+    void resolve()
+    {
+        glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+        glState().viewport(this->viewport[0], this->viewport[1], this->viewport[2], this->viewport[3]);
+        glState().depthMask(GL_TRUE);
+        glState().disable(GL_DEPTH_TEST);
+        glState().enable(GL_BLEND);
+        glState().blendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA); // the target is premultiplied
+
+        this->upsample.use();
+        this->upsample.setInt("factor", this->factor);
+        this->upsample.setFloat("nearPlane", this->nearPlane);
+        this->upsample.setFloat("farPlane", this->farPlane);
+        this->upsample.setFloat("depthThreshold", this->depthThreshold);
+        glState().activeTexture(GL_TEXTURE0);
+        glState().bindTexture(GL_TEXTURE_2D, this->colorTexture);
+        glState().activeTexture(GL_TEXTURE1);
+        glState().bindTexture(GL_TEXTURE_2D, this->depthTexture);
+        glState().activeTexture(GL_TEXTURE2);
+        glState().bindTexture(GL_TEXTURE_2D, this->sceneDepth);
+        glState().bindVertexArray(this->emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glState().bindVertexArray(0);
+        glState().activeTexture(GL_TEXTURE0);
+
+        glState().blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glState().enable(GL_DEPTH_TEST);
+    }
+
+    void deleteBuffers()
+    {
+        glDeleteVertexArrays(1, &this->emptyVAO);
+        glDeleteTextures(1, &this->sceneDepth);
+        glDeleteTextures(1, &this->colorTexture);
+        glDeleteTextures(1, &this->depthTexture);
+        glDeleteFramebuffers(1, &this->sceneDepthFBO);
+        glDeleteFramebuffers(1, &this->FBO);
+    }
+
+private:
+    unsigned int lowWidth, lowHeight;
+    GLuint sceneDepthFBO, sceneDepth;
+    GLuint FBO, colorTexture, depthTexture;
+    GLuint emptyVAO;
+    GLint viewport[4]; // of the screen, saved by begin()
+    Shader downsample, upsample;
+
+    GLuint createTexture(unsigned int width, unsigned int height, GLint internalFormat, GLenum format, GLenum type)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glState().bindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        // only the color is filtered, depths are always fetched
+        GLint filter = format == GL_RGBA ? GL_LINEAR : GL_NEAREST;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glState().bindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    void checkStatus()
+    {
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: Offscreen particle framebuffer is not complete!" << std::endl;
+    }
+};
+#endif
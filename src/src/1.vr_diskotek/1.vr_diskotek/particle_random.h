@@ -0,0 +1,125 @@
+#ifndef PARTICLE_RANDOM_H
+#define PARTICLE_RANDOM_H
+
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PARTICLE_RANDOM_SSE
+#endif
+
+// independent generators stepped together, one per SSE lane
+const unsigned int PARTICLE_RANDOM_LANES = 4;
+
+// Per-emitter random numbers: PARTICLE_RANDOM_LANES xoshiro128+ generators kept side by side,
+// so one step yields a random float for every lane with a handful of SSE2 integer ops. Unlike
+// rand() there is no shared state, so emitters can spawn on any thread, and the same seed
+// always yields the same particles.
+class ParticleRandom
+{
+public:
+    explicit ParticleRandom(uint64_t seed = 1)
+    {
+        this->seed(seed);
+    }
+
+    // restarts the sequence; different seeds give unrelated sequences
+    void seed(uint64_t seed)
+    {
+        // splitmix64 expands the seed into the lane states, it never yields an all zero state
+        for (unsigned int w = 0; w < 4; w++)
+        {
+            for (unsigned int lane = 0; lane < PARTICLE_RANDOM_LANES; lane++)
+            {
+                seed += 0x9E3779B97F4A7C15ull;
+                uint64_t z = seed;
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                this->state[w][lane] = (uint32_t)((z ^ (z >> 31)) >> 32);
+            }
+        }
+    }
+
+    // one random 32-bit integer
+    uint32_t next()
+    {
+        uint32_t lanes[PARTICLE_RANDOM_LANES];
+        step(lanes);
+        return lanes[0];
+    }
+
+    // Fills out[0, n) with uniform floats in [lo, hi). Draws whole steps, so the sequence
+    // only depends on the seed and the sizes of the batches asked for.
+    void uniform(float *out, unsigned int n, float lo, float hi)
+    {
+        const float scale = (hi - lo) * (1.0f / 16777216.0f);
+        unsigned int i = 0;
+#ifdef PARTICLE_RANDOM_SSE
+        const __m128 vscale = _mm_set1_ps(scale);
+        const __m128 vlo = _mm_set1_ps(lo);
+        for (; i + PARTICLE_RANDOM_LANES <= n; i += PARTICLE_RANDOM_LANES)
+        {
+            // the top 24 bits are exact in a float and are the strongest bits of xoshiro128+
+            __m128i bits = _mm_srli_epi32(stepSSE(), 8);
+            _mm_storeu_ps(out + i, _mm_add_ps(vlo, _mm_mul_ps(_mm_cvtepi32_ps(bits), vscale)));
+        }
+#endif
+        while (i < n)
+        {
+            uint32_t lanes[PARTICLE_RANDOM_LANES];
+            step(lanes);
+            for (unsigned int lane = 0; lane < PARTICLE_RANDOM_LANES && i < n; lane++, i++)
+                out[i] = lo + (float)(lanes[lane] >> 8) * scale;
+        }
+    }
+
+private:
+    // xoshiro128 state words, lane-major so one SSE register holds a word of every lane
+    uint32_t state[4][PARTICLE_RANDOM_LANES];
+
+    // advances every lane and writes their outputs
+    void step(uint32_t *out)
+    {
+#ifdef PARTICLE_RANDOM_SSE
+        _mm_storeu_si128((__m128i*)out, stepSSE());
+#else
+        for (unsigned int lane = 0; lane < PARTICLE_RANDOM_LANES; lane++)
+        {
+            uint32_t *s0 = &this->state[0][lane], *s1 = &this->state[1][lane];
+            uint32_t *s2 = &this->state[2][lane], *s3 = &this->state[3][lane];
+            out[lane] = *s0 + *s3;
+            uint32_t t = *s1 << 9;
+            *s2 ^= *s0;
+            *s3 ^= *s1;
+            *s1 ^= *s2;
+            *s0 ^= *s3;
+            *s2 ^= t;
+            *s3 = (*s3 << 11) | (*s3 >> 21);
+        }
+#endif
+    }
+
+#ifdef PARTICLE_RANDOM_SSE
+    __m128i stepSSE()
+    {
+        __m128i s0 = _mm_loadu_si128((const __m128i*)this->state[0]);
+        __m128i s1 = _mm_loadu_si128((const __m128i*)this->state[1]);
+        __m128i s2 = _mm_loadu_si128((const __m128i*)this->state[2]);
+        __m128i s3 = _mm_loadu_si128((const __m128i*)this->state[3]);
+        __m128i result = _mm_add_epi32(s0, s3);
+        __m128i t = _mm_slli_epi32(s1, 9);
+        s2 = _mm_xor_si128(s2, s0);
+        s3 = _mm_xor_si128(s3, s1);
+        s1 = _mm_xor_si128(s1, s2);
+        s0 = _mm_xor_si128(s0, s3);
+        s2 = _mm_xor_si128(s2, t);
+        s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+        _mm_storeu_si128((__m128i*)this->state[0], s0);
+        _mm_storeu_si128((__m128i*)this->state[1], s1);
+        _mm_storeu_si128((__m128i*)this->state[2], s2);
+        _mm_storeu_si128((__m128i*)this->state[3], s3);
+        return result;
+    }
+#endif
+};
+#endif
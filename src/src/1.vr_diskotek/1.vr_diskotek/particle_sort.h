@@ -0,0 +1,200 @@
+#ifndef PARTICLE_SORT_H
+#define PARTICLE_SORT_H
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// bits handled by one radix pass, 3 passes cover a 32-bit key
+const unsigned int PARTICLE_RADIX_BITS = 11;
+const unsigned int PARTICLE_RADIX_BUCKETS = 1u << PARTICLE_RADIX_BITS;
+const unsigned int PARTICLE_RADIX_PASSES = 3;
+// the coherent path gives up after this many element moves per particle
+const unsigned int PARTICLE_SORT_MAX_MOVES = 4;
+
+// Computes a back-to-front draw order for the live particles of a store.
+// Every particle is sorted as a 64-bit <key, index> pair. The key is the squared camera
+// distance as a 32-bit integer (positive floats compare like their bit patterns), inverted
+// so the farthest particle comes first. Consecutive frames are usually almost sorted
+// already: every particle remembers its last rank in the store, so last frame's order is
+// rebuilt in O(n) and fixed up with an insertion sort, and the few particles spawned since
+// are sorted on their own and merged in. Only when the fix-up needs too many moves do we
+// fall back to a full LSD radix sort.
+class ParticleSorter
+{
+public:
+    std::vector<unsigned int> order; // indices into the store, farthest first
+    unsigned int coherentSorts;
+    unsigned int radixSorts;
+
+    ParticleSorter() : coherentSorts(0), radixSorts(0), previousCount(0) { }
+
+    // Store is ParticleStore or CompactParticleStore
+    template <class Store>
+    void sort(Store &particles, const glm::vec3 &cameraPos)
+    {
+        const unsigned int n = particles.count;
+        const unsigned int first = particles.first;
+        reserve(particles.capacity);
+        this->order.resize(n);
+        if (n == 0)
+        {
+            this->previousCount = 0;
+            return;
+        }
+        this->keys.resize(first + n);
+        for (unsigned int i = first; i < first + n; i++)
+        {
+            glm::vec3 d = particles.position(i) - cameraPos;
+            float distance = glm::dot(d, d);
+            unsigned int bits;
+            memcpy(&bits, &distance, sizeof(bits));
+            this->keys[i] = ~bits;
+        }
+
+        if (coherentSort(particles))
+            this->coherentSorts++;
+        else
+        {
+            radixSort(first, n);
+            this->radixSorts++;
+        }
+
+        // remember where everybody ended up for the next frame
+        for (unsigned int j = 0; j < n; j++)
+        {
+            unsigned int i = (unsigned int)this->pairs[j];
+            this->order[j] = i;
+            particles.rank[i] = (float)j;
+        }
+        this->previousCount = n;
+    }
+
+private:
+    std::vector<unsigned int> keys;          // per store slot
+    std::vector<unsigned int> slots;         // previous rank -> store slot
+    std::vector<unsigned long long> pairs;   // <key, index>, sorted in place
+    std::vector<unsigned long long> scratch; // radix ping-pong / merge buffer
+    unsigned int histogram[PARTICLE_RADIX_PASSES][PARTICLE_RADIX_BUCKETS];
+    unsigned int previousCount;
+
+    // sized for a full store up front, so a growing particle count doesn't reallocate every frame
+    void reserve(unsigned int capacity)
+    {
+        if (this->pairs.capacity() >= capacity)
+            return;
+        this->order.reserve(capacity);
+        this->keys.reserve(capacity);
+        this->slots.reserve(capacity);
+        this->pairs.reserve(capacity);
+        this->scratch.reserve(capacity);
+    }
+
+    unsigned long long pair(unsigned int i) const
+    {
+        return ((unsigned long long)this->keys[i] << 32) | i;
+    }
+
+    // Sorts starting from last frame's order, false when there is none or it changed too much.
+    template <class Store>
+    bool coherentSort(const Store &particles)
+    {
+        if (this->previousCount == 0)
+            return false;
+        const unsigned int n = particles.count;
+        const unsigned int empty = 0xFFFFFFFFu;
+        this->slots.assign(this->previousCount, empty);
+        this->pairs.resize(n);
+        this->scratch.resize(n);
+
+        // newcomers are collected from the back of pairs, the survivors from its front
+        unsigned int newcomers = 0;
+        for (unsigned int i = particles.first; i < particles.first + n; i++)
+        {
+            float rank = particles.rank[i];
+            if (rank >= 0.0f && rank < (float)this->previousCount)
+                this->slots[(unsigned int)rank] = i;
+            else
+                this->pairs[n - ++newcomers] = pair(i);
+        }
+        unsigned int survivors = 0;
+        for (unsigned int r = 0; r < this->previousCount; r++)
+        {
+            if (this->slots[r] != empty)
+                this->pairs[survivors++] = pair(this->slots[r]);
+        }
+
+        // two particles claiming the same rank leave a gap between both runs
+        if (survivors + newcomers != n || !insertionSort(this->pairs.data(), survivors))
+            return false;
+        unsigned long long *spawned = this->pairs.data() + survivors;
+        std::sort(spawned, spawned + newcomers);
+        // merged into the other buffer, std::merge must not write over its inputs
+        std::merge(this->pairs.begin(), this->pairs.begin() + survivors, spawned, spawned + newcomers, this->scratch.begin());
+        this->pairs.swap(this->scratch);
+        return true;
+    }
+
+    // insertion sort, false if it ran out of its move budget
+    static bool insertionSort(unsigned long long *values, unsigned int n)
+    {
+        unsigned long long budget = (unsigned long long)n * PARTICLE_SORT_MAX_MOVES;
+        for (unsigned int j = 1; j < n; j++)
+        {
+            unsigned long long value = values[j];
+            unsigned int k = j;
+            while (k > 0 && values[k - 1] > value)
+            {
+                values[k] = values[k - 1];
+                k--;
+            }
+            values[k] = value;
+            if (j - k > budget)
+                return false;
+            budget -= j - k;
+        }
+        return true;
+    }
+
+    // LSD radix sort of the slots [first, first + n) on the key half of the pairs;
+    // passes where every key lands in the same bucket are skipped
+    void radixSort(unsigned int first, unsigned int n)
+    {
+        this->pairs.resize(n);
+        this->scratch.resize(n);
+        memset(this->histogram, 0, sizeof(this->histogram));
+        for (unsigned int j = 0; j < n; j++)
+        {
+            unsigned int key = this->keys[first + j];
+            this->pairs[j] = pair(first + j);
+            for (unsigned int p = 0; p < PARTICLE_RADIX_PASSES; p++)
+                this->histogram[p][(key >> (p * PARTICLE_RADIX_BITS)) & (PARTICLE_RADIX_BUCKETS - 1)]++;
+        }
+
+        unsigned long long *src = this->pairs.data();
+        unsigned long long *dst = this->scratch.data();
+        for (unsigned int p = 0; p < PARTICLE_RADIX_PASSES; p++)
+        {
+            unsigned int shift = 32 + p * PARTICLE_RADIX_BITS;
+            unsigned int *counts = this->histogram[p];
+            if (counts[(src[0] >> shift) & (PARTICLE_RADIX_BUCKETS - 1)] == n)
+                continue;
+            // bucket counts -> bucket starts
+            unsigned int offset = 0;
+            for (unsigned int b = 0; b < PARTICLE_RADIX_BUCKETS; b++)
+            {
+                unsigned int c = counts[b];
+                counts[b] = offset;
+                offset += c;
+            }
+            for (unsigned int j = 0; j < n; j++)
+                dst[counts[(src[j] >> shift) & (PARTICLE_RADIX_BUCKETS - 1)]++] = src[j];
+            std::swap(src, dst);
+        }
+        if (src != this->pairs.data())
+            this->pairs.swap(this->scratch);
+    }
+};
+#endif
@@ -0,0 +1,386 @@
+#ifndef PARTICLE_STORE_H
+#define PARTICLE_STORE_H
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define PARTICLE_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PARTICLE_SIMD_SSE
+#endif
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// number of particles processed by one instruction of the simulation kernel
+#if defined(PARTICLE_SIMD_AVX)
+const unsigned int PARTICLE_SIMD_WIDTH = 8;
+#elif defined(PARTICLE_SIMD_SSE)
+const unsigned int PARTICLE_SIMD_WIDTH = 4;
+#else
+const unsigned int PARTICLE_SIMD_WIDTH = 1;
+#endif
+// every stream starts on a 32 byte boundary, enough for both SSE and AVX loads
+const unsigned int PARTICLE_STREAM_ALIGNMENT = 32;
+const unsigned int PARTICLE_STREAM_PADDING = PARTICLE_STREAM_ALIGNMENT / sizeof(float);
+// floats per particle in the interleaved instance data: <vec3 offset, vec4 color>
+const unsigned int PARTICLE_INSTANCE_FLOATS = 7;
+
+// storage for particle streams, aligned to PARTICLE_STREAM_ALIGNMENT
+inline void* particleAlignedAlloc(size_t bytes)
+{
+#ifdef _WIN32
+    return _aligned_malloc(bytes, PARTICLE_STREAM_ALIGNMENT);
+#else
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, PARTICLE_STREAM_ALIGNMENT, bytes) != 0)
+        return NULL;
+    return ptr;
+#endif
+}
+
+inline void particleAlignedFree(void *ptr)
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+// Structure-of-arrays particle storage: every attribute lives in its own stream so the
+// simulation kernel can load several particles per instruction. Live particles are packed
+// in [first, first + count) in spawn order, so the oldest one is always at first. Spawning
+// appends after the live range and retiring the oldest just moves first, both O(1); dead
+// particles are compacted away by simulate(), which also moves the live range back to 0.
+class ParticleStore
+{
+public:
+    // streams
+    float *posX, *posY, *posZ;
+    float *speedX, *speedY, *speedZ;
+    float *life;
+    float *colorR, *colorG, *colorB, *colorA;
+    // position in last frame's depth sorted order, -1 for particles spawned since
+    float *rank;
+
+    unsigned int first;
+    unsigned int count;
+    unsigned int capacity;
+
+    ParticleStore() : first(0), count(0), capacity(0), slots(0), stride(0), block(NULL)
+    {
+        assignStreams();
+    }
+
+    explicit ParticleStore(unsigned int capacity, unsigned int headroom = 0) : first(0), count(0), capacity(0), slots(0), stride(0), block(NULL)
+    {
+        allocate(capacity, headroom);
+    }
+
+    ~ParticleStore()
+    {
+        release();
+    }
+
+    // Reserve room for the given number of live particles, dropping the current content.
+    // headroom is the number of particles that may be retired and respawned between two
+    // calls to simulate() (i.e. the most a frame can spawn).
+    void allocate(unsigned int newCapacity, unsigned int headroom = 0)
+    {
+        release();
+        capacity = newCapacity;
+        slots = newCapacity + headroom;
+        // pad each stream so the next one stays aligned and the kernel never needs a scalar tail
+        stride = (slots + PARTICLE_STREAM_PADDING - 1) / PARTICLE_STREAM_PADDING * PARTICLE_STREAM_PADDING;
+        size_t bytes = (size_t)stride * NR_STREAMS * sizeof(float);
+        if (bytes > 0)
+        {
+            block = (float*)particleAlignedAlloc(bytes);
+            memset(block, 0, bytes);
+        }
+        assignStreams();
+    }
+
+    // Appends a particle slot after the live range, -1 when the store is full.
+    int push()
+    {
+        if (count == capacity || first + count == slots)
+            return -1;
+        return (int)(first + count++);
+    }
+
+    // Drops the oldest live particle.
+    void retireOldest()
+    {
+        if (count == 0)
+            return;
+        first++;
+        count--;
+    }
+
+    // gives this store the same capacity and headroom as other
+    void allocateLike(const ParticleStore &other)
+    {
+        allocate(other.capacity, other.slots - other.capacity);
+    }
+
+    // writes a single particle into slot i
+    void set(unsigned int i, const glm::vec3 &pos, const glm::vec3 &speed, const glm::vec4 &color, float lifetime)
+    {
+        posX[i] = pos.x;     posY[i] = pos.y;     posZ[i] = pos.z;
+        speedX[i] = speed.x; speedY[i] = speed.y; speedZ[i] = speed.z;
+        colorR[i] = color.r; colorG[i] = color.g; colorB[i] = color.b; colorA[i] = color.a;
+        life[i] = lifetime;
+        rank[i] = -1.0f;
+    }
+
+    glm::vec3 position(unsigned int i) const { return glm::vec3(posX[i], posY[i], posZ[i]); }
+    glm::vec4 color(unsigned int i) const { return glm::vec4(colorR[i], colorG[i], colorB[i], colorA[i]); }
+
+    // interleaves n particles starting at first into <vec3 offset, vec4 color> instance records
+    void packInstances(float *out, unsigned int first, unsigned int n) const
+    {
+        for (unsigned int i = first; i < first + n; i++)
+        {
+            out[0] = posX[i];   out[1] = posY[i];   out[2] = posZ[i];
+            out[3] = colorR[i]; out[4] = colorG[i]; out[5] = colorB[i]; out[6] = colorA[i];
+            out += PARTICLE_INSTANCE_FLOATS;
+        }
+    }
+
+    // same as above, following a draw order of n indices instead of the storage order
+    void packInstances(float *out, const unsigned int *order, unsigned int n) const
+    {
+        for (unsigned int j = 0; j < n; j++)
+        {
+            unsigned int i = order[j];
+            out[0] = posX[i];   out[1] = posY[i];   out[2] = posZ[i];
+            out[3] = colorR[i]; out[4] = colorG[i]; out[5] = colorB[i]; out[6] = colorA[i];
+            out += PARTICLE_INSTANCE_FLOATS;
+        }
+    }
+
+    // Advances all live particles by delta seconds (gravity only, no collisions) and
+    // compacts the dead ones away in place, keeping the survivors in their spawn order.
+    // Returns the number of live particles.
+    unsigned int simulate(float delta)
+    {
+        const float gravity = -9.81f * delta * 0.5f;
+        const unsigned int end = first + count;
+        unsigned int write = 0;
+        // start on a vector boundary, lanes outside of the live range are treated as dead
+        for (unsigned int i = first / PARTICLE_SIMD_WIDTH * PARTICLE_SIMD_WIDTH; i < end; i += PARTICLE_SIMD_WIDTH)
+        {
+            unsigned int alive = integrateBlock(i, delta, gravity) & laneMask(i, first, end);
+            write = copySurvivors(*this, i, alive, *this, write);
+        }
+        first = 0;
+        count = write;
+        return count;
+    }
+
+    // Compacts the dead particles away without moving the live ones, for simulations that
+    // advance the streams themselves (see ParticleFluid). Returns the number of live particles.
+    unsigned int removeDead()
+    {
+        const unsigned int end = first + count;
+        unsigned int write = 0;
+        for (unsigned int i = first / PARTICLE_SIMD_WIDTH * PARTICLE_SIMD_WIDTH; i < end; i += PARTICLE_SIMD_WIDTH)
+            write = copySurvivors(*this, i, aliveBlock(i) & laneMask(i, first, end), *this, write);
+        first = 0;
+        count = write;
+        return count;
+    }
+
+    // The two halves of simulate() for several threads working on one store. integrate()
+    // advances the live particles inside [begin, end) in place and returns how many
+    // survived; gather() then copies those survivors, in order, into dst from offset on.
+    // Ranges handled concurrently must start on a multiple of PARTICLE_SIMD_WIDTH.
+    unsigned int integrate(unsigned int begin, unsigned int end, float delta)
+    {
+        const float gravity = -9.81f * delta * 0.5f;
+        clipToLiveRange(begin, end);
+        unsigned int survivors = 0;
+        for (unsigned int i = begin / PARTICLE_SIMD_WIDTH * PARTICLE_SIMD_WIDTH; i < end; i += PARTICLE_SIMD_WIDTH)
+            survivors += countBits(integrateBlock(i, delta, gravity) & laneMask(i, begin, end));
+        return survivors;
+    }
+
+    void gather(unsigned int begin, unsigned int end, ParticleStore &dst, unsigned int offset) const
+    {
+        clipToLiveRange(begin, end);
+        for (unsigned int i = begin / PARTICLE_SIMD_WIDTH * PARTICLE_SIMD_WIDTH; i < end; i += PARTICLE_SIMD_WIDTH)
+            offset = copySurvivors(*this, i, aliveBlock(i) & laneMask(i, begin, end), dst, offset);
+    }
+
+    // exchanges the content of two stores, used to flip between gather() buffers
+    void swap(ParticleStore &other)
+    {
+        std::swap(first, other.first);
+        std::swap(count, other.count);
+        std::swap(capacity, other.capacity);
+        std::swap(slots, other.slots);
+        std::swap(stride, other.stride);
+        std::swap(block, other.block);
+        assignStreams();
+        other.assignStreams();
+    }
+
+private:
+    static const unsigned int NR_STREAMS = 12;
+    unsigned int slots;
+    unsigned int stride;
+    float *block;
+
+    // not copyable: the streams point into a single owned allocation
+    ParticleStore(const ParticleStore&);
+    ParticleStore& operator=(const ParticleStore&);
+
+    void assignStreams()
+    {
+        float **streams[NR_STREAMS] = { &posX, &posY, &posZ, &speedX, &speedY, &speedZ, &life, &colorR, &colorG, &colorB, &colorA, &rank };
+        for (unsigned int s = 0; s < NR_STREAMS; s++)
+            *streams[s] = block ? block + (size_t)s * stride : NULL;
+    }
+
+    void release()
+    {
+        if (block)
+            particleAlignedFree(block);
+        block = NULL;
+        first = count = capacity = slots = stride = 0;
+        assignStreams();
+    }
+
+    void clipToLiveRange(unsigned int &begin, unsigned int &end) const
+    {
+        if (begin < first)
+            begin = first;
+        if (end > first + count)
+            end = first + count;
+    }
+
+    // bit per lane of the block starting at i that lies inside [begin, end)
+    static unsigned int laneMask(unsigned int i, unsigned int begin, unsigned int end)
+    {
+        unsigned int lo = begin > i ? begin - i : 0;
+        unsigned int hi = end - i < PARTICLE_SIMD_WIDTH ? end - i : PARTICLE_SIMD_WIDTH;
+        return ((1u << hi) - 1u) & ~((1u << lo) - 1u);
+    }
+
+    static unsigned int countBits(unsigned int mask)
+    {
+        unsigned int bits = 0;
+        for (; mask; mask &= mask - 1u)
+            bits++;
+        return bits;
+    }
+
+    // Copies the lanes set in alive of the block at i to dst, packed from write on, and
+    // returns the next write position. dst may be src as long as write <= i.
+    static unsigned int copySurvivors(const ParticleStore &src, unsigned int i, unsigned int alive, ParticleStore &dst, unsigned int write)
+    {
+        if (alive == (1u << PARTICLE_SIMD_WIDTH) - 1u)
+        {
+            // the whole block survived: move it in one go
+            if (&src != &dst || write != i)
+                copyBlock(src, i, dst, write);
+            return write + PARTICLE_SIMD_WIDTH;
+        }
+        for (unsigned int lane = 0; alive; lane++, alive >>= 1)
+        {
+            if (alive & 1u)
+                copyParticle(src, i + lane, dst, write++);
+        }
+        return write;
+    }
+
+    static void copyParticle(const ParticleStore &src, unsigned int from, ParticleStore &dst, unsigned int to)
+    {
+        if (&src == &dst && from == to)
+            return;
+        for (unsigned int s = 0; s < NR_STREAMS; s++)
+            dst.block[(size_t)s * dst.stride + to] = src.block[(size_t)s * src.stride + from];
+    }
+
+#if defined(PARTICLE_SIMD_AVX)
+    // integrates PARTICLE_SIMD_WIDTH particles starting at i in place and returns the alive lane mask
+    unsigned int integrateBlock(unsigned int i, float delta, float gravity)
+    {
+        const __m256 dt = _mm256_set1_ps(delta);
+        __m256 l = _mm256_sub_ps(_mm256_load_ps(life + i), dt);
+        __m256 vy = _mm256_add_ps(_mm256_load_ps(speedY + i), _mm256_set1_ps(gravity));
+        _mm256_store_ps(life + i, l);
+        _mm256_store_ps(speedY + i, vy);
+        _mm256_store_ps(posX + i, _mm256_add_ps(_mm256_load_ps(posX + i), _mm256_mul_ps(_mm256_load_ps(speedX + i), dt)));
+        _mm256_store_ps(posY + i, _mm256_add_ps(_mm256_load_ps(posY + i), _mm256_mul_ps(vy, dt)));
+        _mm256_store_ps(posZ + i, _mm256_add_ps(_mm256_load_ps(posZ + i), _mm256_mul_ps(_mm256_load_ps(speedZ + i), dt)));
+        return (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(l, _mm256_setzero_ps(), _CMP_GT_OQ));
+    }
+
+    unsigned int aliveBlock(unsigned int i) const
+    {
+        return (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(_mm256_load_ps(life + i), _mm256_setzero_ps(), _CMP_GT_OQ));
+    }
+
+    static void copyBlock(const ParticleStore &src, unsigned int from, ParticleStore &dst, unsigned int to)
+    {
+        for (unsigned int s = 0; s < NR_STREAMS; s++)
+            _mm256_storeu_ps(dst.block + (size_t)s * dst.stride + to, _mm256_load_ps(src.block + (size_t)s * src.stride + from));
+    }
+#elif defined(PARTICLE_SIMD_SSE)
+    // integrates PARTICLE_SIMD_WIDTH particles starting at i in place and returns the alive lane mask
+    unsigned int integrateBlock(unsigned int i, float delta, float gravity)
+    {
+        const __m128 dt = _mm_set1_ps(delta);
+        __m128 l = _mm_sub_ps(_mm_load_ps(life + i), dt);
+        __m128 vy = _mm_add_ps(_mm_load_ps(speedY + i), _mm_set1_ps(gravity));
+        _mm_store_ps(life + i, l);
+        _mm_store_ps(speedY + i, vy);
+        _mm_store_ps(posX + i, _mm_add_ps(_mm_load_ps(posX + i), _mm_mul_ps(_mm_load_ps(speedX + i), dt)));
+        _mm_store_ps(posY + i, _mm_add_ps(_mm_load_ps(posY + i), _mm_mul_ps(vy, dt)));
+        _mm_store_ps(posZ + i, _mm_add_ps(_mm_load_ps(posZ + i), _mm_mul_ps(_mm_load_ps(speedZ + i), dt)));
+        return (unsigned int)_mm_movemask_ps(_mm_cmpgt_ps(l, _mm_setzero_ps()));
+    }
+
+    unsigned int aliveBlock(unsigned int i) const
+    {
+        return (unsigned int)_mm_movemask_ps(_mm_cmpgt_ps(_mm_load_ps(life + i), _mm_setzero_ps()));
+    }
+
+    static void copyBlock(const ParticleStore &src, unsigned int from, ParticleStore &dst, unsigned int to)
+    {
+        for (unsigned int s = 0; s < NR_STREAMS; s++)
+            _mm_storeu_ps(dst.block + (size_t)s * dst.stride + to, _mm_load_ps(src.block + (size_t)s * src.stride + from));
+    }
+#else
+    unsigned int integrateBlock(unsigned int i, float delta, float gravity)
+    {
+        life[i] -= delta;
+        speedY[i] += gravity;
+        posX[i] += speedX[i] * delta;
+        posY[i] += speedY[i] * delta;
+        posZ[i] += speedZ[i] * delta;
+        return life[i] > 0.0f ? 1u : 0u;
+    }
+
+    unsigned int aliveBlock(unsigned int i) const
+    {
+        return life[i] > 0.0f ? 1u : 0u;
+    }
+
+    static void copyBlock(const ParticleStore &src, unsigned int from, ParticleStore &dst, unsigned int to)
+    {
+        copyParticle(src, from, dst, to);
+    }
+#endif
+};
+#endif
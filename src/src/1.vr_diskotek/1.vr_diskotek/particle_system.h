@@ -0,0 +1,263 @@
+#ifndef PARTICLE_SYSTEM_H
+#define PARTICLE_SYSTEM_H
+
+#include <glm/glm.hpp>
+#include <learnopengl/frustum.h>
+#include <learnopengl/thread_pool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#include "particle_container.cpp"
+
+// particles handled by one job; a multiple of every SIMD width so chunks never share a vector
+const unsigned int PARTICLE_CHUNK_SIZE = 16384;
+
+// Owns all the emitters and advances them on a worker pool. CPU emitters are cut into
+// PARTICLE_CHUNK_SIZE chunks and the chunks of every emitter run in parallel while the main
+// thread keeps issuing GL work; wait() joins them before anything reads the particles.
+//
+// The frame cost is kept bounded no matter how many emitters there are: emitters outside the
+// view frustum are frozen (no spawning, simulation or drawing), visible ones emit less and draw
+// larger sprites as their screen coverage shrinks, and new particles are only spawned while
+// the visible emitters stay under a global budget of live particles.
+class ParticleSystem
+{
+public:
+    std::vector<ParticleContainer*> emitters;
+    unsigned int budget;      // live particles over all visible emitters, 0 for no limit
+    float fullDetailCoverage; // screen coverage (fraction of the half height) that gets full emission
+    float minEmission;        // emission rate of a barely visible emitter
+    // statistics of the last simulateAsync()
+    unsigned int visibleEmitters;
+    unsigned int liveParticles;
+
+    // threads == 0 starts one worker per hardware thread besides the calling one
+    explicit ParticleSystem(unsigned int budget = 0, unsigned int threads = 0)
+        : budget(budget), fullDetailCoverage(0.5f), minEmission(0.1f), visibleEmitters(0), liveParticles(0),
+          pool(threads), delta(0.0f), cameraPos(0.0f) { }
+
+    ~ParticleSystem()
+    {
+        this->pool.wait();
+        for (unsigned int i = 0; i < this->emitters.size(); i++)
+        {
+            delete this->emitters[i];
+            delete this->steps[i];
+        }
+    }
+
+    // takes ownership of the emitter
+    void add(ParticleContainer* emitter)
+    {
+        this->emitters.push_back(emitter);
+        this->steps.push_back(new Step());
+    }
+
+    // composites every emitter with the given blending, joins the workers first since they read it
+    void setBlend(ParticleBlend blend)
+    {
+        this->wait();
+        for (unsigned int e = 0; e < this->emitters.size(); e++)
+            this->emitters[e]->blend = blend;
+    }
+
+    // moves every emitter with the given dynamics, joins the workers first since they step them
+    void setDynamics(ParticleDynamics dynamics)
+    {
+        this->wait();
+        for (unsigned int e = 0; e < this->emitters.size(); e++)
+            this->emitters[e]->setDynamics(dynamics);
+    }
+
+    // Picks the level of detail of every emitter for the camera, spawns the new particles on
+    // the calling thread (it owns the GL context and the emitters' random state), then hands
+    // the integration and the depth sort over to the workers and returns.
+    void simulateAsync(float delta, const glm::vec3 &cameraPos, const glm::mat4 &projection, const glm::mat4 &view)
+    {
+        this->wait();
+        this->delta = delta;
+        this->cameraPos = cameraPos;
+        this->updateLevelOfDetail(projection, view);
+        for (unsigned int e = 0; e < this->emitters.size(); e++)
+        {
+            ParticleContainer* emitter = this->emitters[e];
+            if (!emitter->visible)
+                continue;
+            if (emitter->playback) {
+                // baked: nothing to spawn or simulate, the cache is sampled at draw time
+                emitter->advancePlayback(delta);
+                continue;
+            }
+            emitter->generateParticles(this->steps[e]->spawn);
+            if (emitter->backend == PARTICLE_BACKEND_GPU) {
+                emitter->simulateParticles(delta);
+                continue;
+            }
+            if (emitter->fluid) {
+                // the fluid queues its own passes, each one split over the workers
+                emitter->fluid->schedule(this->pool, emitter->particles, delta, [this, e] {
+                    this->emitters[e]->sortParticles(this->cameraPos);
+                });
+                continue;
+            }
+
+            if (emitter->format == PARTICLE_FORMAT_COMPACT)
+                this->scheduleChunks(e, emitter->compact, this->steps[e]->compactSpare);
+            else
+                this->scheduleChunks(e, emitter->particles, this->steps[e]->spare);
+        }
+    }
+
+    // joins the workers, call it before reading or drawing the particles
+    void wait()
+    {
+        this->pool.wait();
+    }
+
+    void draw(unsigned int texture, glm::mat4 proj, glm::mat4 view)
+    {
+        for (unsigned int e = 0; e < this->emitters.size(); e++)
+        {
+            if (this->emitters[e]->visible)
+                this->emitters[e]->draw(texture, proj, view);
+        }
+    }
+
+    void deleteBuffers()
+    {
+        this->wait();
+        for (unsigned int e = 0; e < this->emitters.size(); e++)
+            this->emitters[e]->deleteBuffers();
+    }
+
+private:
+    // bookkeeping of one emitter's chunked step
+    struct Step {
+        int spawn;           // particles to emit this frame
+        unsigned int base;   // first particle of chunk 0
+        unsigned int chunks;
+        std::vector<unsigned int> survivors; // per chunk, turned into output offsets
+        std::atomic<unsigned int> remaining;
+        // gather targets, swapped with the emitter's store
+        ParticleStore spare;
+        CompactParticleStore compactSpare;
+    };
+
+    ThreadPool pool;
+    std::vector<Step*> steps;
+    float delta;
+    glm::vec3 cameraPos;
+
+    // Culls the emitters against the view frustum, scales the emission of the visible ones by
+    // their screen coverage and fits the particles they want to spawn into the budget.
+    void updateLevelOfDetail(const glm::mat4 &projection, const glm::mat4 &view)
+    {
+        Frustum frustum(projection * view);
+        // projection[1][1] = 1 / tan(fovy / 2) turns radius / distance into screen coverage
+        float focal = projection[1][1];
+        unsigned int live = 0;
+        int requested = 0;
+        this->visibleEmitters = 0;
+        for (unsigned int e = 0; e < this->emitters.size(); e++)
+        {
+            ParticleContainer* emitter = this->emitters[e];
+            Step* step = this->steps[e];
+            step->spawn = 0;
+            emitter->visible = frustum.intersectsSphere(emitter->posInit, emitter->boundsRadius);
+            if (!emitter->visible)
+                continue;
+
+            float distance = std::max(glm::length(emitter->posInit - this->cameraPos), emitter->boundsRadius);
+            float coverage = emitter->boundsRadius * focal / distance;
+            emitter->emission = std::max(std::min(coverage / this->fullDetailCoverage, 1.0f), this->minEmission);
+            // fewer particles, bigger sprites: keeps the area they cover about the same
+            emitter->spriteScale = 1.0f / std::sqrt(emitter->emission);
+            if (emitter->playback)
+                emitter->spriteScale = 1.0f; // a cache always plays every particle it baked
+
+            step->spawn = emitter->playback ? 0 : emitter->emissionCount(this->delta);
+            requested += step->spawn;
+            live += emitter->liveParticles();
+            this->visibleEmitters++;
+        }
+        this->liveParticles = live;
+        if (this->budget == 0 || live + requested <= this->budget)
+            return;
+
+        // over budget: every visible emitter gets the same share of what is left, and never
+        // less than minEmission so that a full pool keeps being renewed
+        float share = live < this->budget ? (float)(this->budget - live) / requested : 0.0f;
+        share = std::max(share, this->minEmission);
+        for (unsigned int e = 0; e < this->emitters.size(); e++)
+            this->steps[e]->spawn = (int)(this->steps[e]->spawn * share);
+    }
+
+    // Store is the emitter's ParticleStore or CompactParticleStore, spare the matching Step one
+    template <class Store>
+    void scheduleChunks(unsigned int e, Store& particles, Store& spare)
+    {
+        Step* step = this->steps[e];
+        step->base = particles.first / PARTICLE_CHUNK_SIZE * PARTICLE_CHUNK_SIZE;
+        step->chunks = (particles.first + particles.count - step->base + PARTICLE_CHUNK_SIZE - 1) / PARTICLE_CHUNK_SIZE;
+        if (step->chunks <= 1) {
+            // small emitter: a single in-place pass is cheaper than integrate + gather
+            this->pool.submit([this, e] {
+                this->emitters[e]->simulateParticles(this->delta);
+                this->emitters[e]->sortParticles(this->cameraPos);
+            });
+            return;
+        }
+
+        if (spare.capacity != particles.capacity)
+            spare.allocateLike(particles);
+        step->survivors.resize(step->chunks);
+        step->remaining = step->chunks;
+        Store* stores = &particles;
+        Store* spares = &spare;
+        for (unsigned int c = 0; c < step->chunks; c++)
+            this->pool.submit([this, e, c, stores, spares] { this->integrateChunk(e, c, *stores, *spares); });
+    }
+
+    // phase 1: integrate a chunk in place; the last chunk to finish schedules the gather
+    template <class Store>
+    void integrateChunk(unsigned int e, unsigned int c, Store& particles, Store& spare)
+    {
+        Step* step = this->steps[e];
+        unsigned int begin = step->base + c * PARTICLE_CHUNK_SIZE;
+        step->survivors[c] = particles.integrate(begin, begin + PARTICLE_CHUNK_SIZE, this->delta);
+        if (step->remaining.fetch_sub(1) != 1)
+            return;
+
+        unsigned int offset = 0;
+        for (unsigned int i = 0; i < step->chunks; i++) {
+            unsigned int survivors = step->survivors[i];
+            step->survivors[i] = offset;
+            offset += survivors;
+        }
+        spare.first = 0;
+        spare.count = offset;
+        step->remaining = step->chunks;
+        Store* stores = &particles;
+        Store* spares = &spare;
+        for (unsigned int i = 0; i < step->chunks; i++)
+            this->pool.submit([this, e, i, stores, spares] { this->gatherChunk(e, i, *stores, *spares); });
+    }
+
+    // phase 2: pack a chunk's survivors into the spare store; the last one swaps the stores
+    // and sorts the result
+    template <class Store>
+    void gatherChunk(unsigned int e, unsigned int c, Store& particles, Store& spare)
+    {
+        Step* step = this->steps[e];
+        unsigned int begin = step->base + c * PARTICLE_CHUNK_SIZE;
+        particles.gather(begin, begin + PARTICLE_CHUNK_SIZE, spare, step->survivors[c]);
+        if (step->remaining.fetch_sub(1) != 1)
+            return;
+        particles.swap(spare);
+        this->emitters[e]->sortParticles(this->cameraPos);
+    }
+};
+#endif
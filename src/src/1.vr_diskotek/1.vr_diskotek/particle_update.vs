@@ -0,0 +1,73 @@
+#version 330 core
+// Advances one particle per vertex; the outputs are captured with transform feedback
+// into the other state buffer, nothing is rasterized.
+layout (location = 0) in vec4 posLife; // <vec3 position, float life>
+layout (location = 1) in vec4 speed;   // <vec3 speed, unused>
+layout (location = 2) in vec4 color;
+
+out vec4 outPosLife;
+out vec4 outSpeed;
+out vec4 outColor;
+
+uniform float delta;
+uniform vec3 origin;
+uniform float lifetime;
+uniform float spread;
+// dead slots in [spawnStart, spawnStart + spawnCount) (wrapping around capacity) are respawned
+uniform uint spawnStart;
+uniform uint spawnCount;
+uniform uint capacity;
+uniform uint seed;
+
+uint hash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+// uniform random number in [0, 1)
+float random(inout uint state)
+{
+    state = hash(state);
+    return float(state >> 8) * (1.0 / 16777216.0);
+}
+
+void main()
+{
+    uint slot = uint(gl_VertexID);
+    float life = posLife.w;
+
+    if (life <= 0.0)
+    {
+        uint window = (slot + capacity - spawnStart) % capacity;
+        if (window < spawnCount)
+        {
+            // emit a new particle
+            uint state = hash(slot ^ hash(seed));
+            vec3 randomdir = vec3(random(state), random(state), random(state)) * 2.0 - 1.0;
+            float rColor = 0.5 + random(state);
+            outPosLife = vec4(origin, lifetime);
+            outSpeed = vec4(vec3(0.0, 1.0, 0.0) + randomdir * spread, 0.0);
+            outColor = vec4(rColor, rColor, rColor, 1.0);
+        }
+        else
+        {
+            outPosLife = posLife;
+            outSpeed = speed;
+            outColor = vec4(color.rgb, 0.0);
+        }
+        return;
+    }
+
+    // simple physics: gravity only, no collisions
+    life -= delta;
+    vec3 v = speed.xyz + vec3(0.0, -9.81, 0.0) * delta * 0.5;
+    outPosLife = vec4(posLife.xyz + v * delta, life);
+    outSpeed = vec4(v, 0.0);
+    // a zero alpha tells particle.vs to cull the particle
+    outColor = vec4(color.rgb, life > 0.0 ? color.a : 0.0);
+}
@@ -0,0 +1,41 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D particleColor; // low resolution, premultiplied
+uniform sampler2D particleDepth; // low resolution, farthest depth of every block
+uniform sampler2D sceneDepth;    // full resolution
+uniform int factor;
+uniform float nearPlane;
+uniform float farPlane;
+uniform float depthThreshold;
+
+float linearDepth(float depth)
+{
+    float z = depth * 2.0 - 1.0;
+    return (2.0 * nearPlane * farPlane) / (farPlane + nearPlane - z * (farPlane - nearPlane));
+}
+
+void main()
+{
+    ivec2 size = textureSize(particleColor, 0);
+    vec2 low = gl_FragCoord.xy / float(factor); // position in low resolution pixels
+    float depth = linearDepth(texelFetch(sceneDepth, ivec2(gl_FragCoord.xy), 0).r);
+
+    // the four low resolution texels the bilinear filter would blend
+    ivec2 origin = ivec2(floor(low - 0.5));
+    ivec2 nearest = clamp(origin, ivec2(0), size - 1);
+    float nearestDifference = 1e30;
+    bool edge = false;
+    for (int i = 0; i < 4; i++) {
+        ivec2 texel = clamp(origin + ivec2(i & 1, i >> 1), ivec2(0), size - 1);
+        float difference = abs(linearDepth(texelFetch(particleDepth, texel, 0).r) - depth);
+        if (difference > depthThreshold * depth)
+            edge = true;
+        if (difference < nearestDifference) {
+            nearestDifference = difference;
+            nearest = texel;
+        }
+    }
+
+    FragColor = edge ? texelFetch(particleColor, nearest, 0) : texture(particleColor, low / vec2(size));
+}
@@ -0,0 +1,200 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/material.h>
+#include <learnopengl/model.h>
+#include <learnopengl/shader_m.h>
+
+#include "particle_system.h"
+#include "scene_uniforms.h"
+
+#include <string>
+#include <vector>
+
+// Textures bound under the ones a model brings, for its meshes that have none (unit 0, see
+// Scene::addMaterial), and the shininess the lit program uses for them.
+struct SceneMaterial {
+    Material textures;
+    float shininess;
+};
+
+// one placement of a model, or of a plain vertex array, in the room
+struct SceneInstance {
+    int model;            // index in Scene::models, -1 draws the vertex array below
+    GLuint vertexArray;
+    GLsizei vertices;     // glDrawArrays count of the vertex array
+    unsigned int material;
+    glm::mat4 transform;
+    bool spins;           // turned around its up axis by the rotation angle of the frame
+    bool lit;             // drawn by draw(), the mirror ball is drawn on its own with drawInstance()
+    bool castsShadow;     // drawn by drawDepth()
+    bool hiddenWithMirror;// left out of draw() while the mirror ball reflects the room
+};
+
+// Everything the room is made of: the models (moved in, never copied), the materials and
+// instances placing them, the point lights and the fountains' emitters. It is built once and
+// drawn by reference; nothing in the draw functions allocates, so the frame does not either.
+class Scene
+{
+public:
+    // the shadow map is sampled from this unit, past the units the models' textures take
+    static const GLuint SHADOW_MAP_UNIT = 2;
+
+    std::vector<Model> models;
+    std::vector<SceneMaterial> materials;
+    std::vector<SceneInstance> instances;
+    glm::vec3 lightPositions[SCENE_POINT_LIGHTS];
+    glm::vec3 lightColors[SCENE_POINT_LIGHTS];
+    ParticleSystem particles;
+    // lamp cubes at the lights and the skybox around the room
+    GLuint lampVertexArray;
+    GLuint skyboxVertexArray;
+    GLuint skyboxTexture;
+
+    explicit Scene(unsigned int particleBudget = 0)
+        : particles(particleBudget), lampVertexArray(0), skyboxVertexArray(0), skyboxTexture(0)
+    {
+        for (int i = 0; i < SCENE_POINT_LIGHTS; i++)
+            this->lightPositions[i] = this->lightColors[i] = glm::vec3(0.0f);
+    }
+
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+
+    // loads the model and returns its index
+    unsigned int addModel(const std::string &path)
+    {
+        this->models.push_back(Model(path));
+        return (unsigned int)this->models.size() - 1;
+    }
+
+    // a material binding texture on unit 0 as texture_diffuse1 and, with specular, as
+    // texture_specular1 too; texture 0 binds nothing
+    unsigned int addMaterial(float shininess, GLuint texture = 0, bool specular = false)
+    {
+        SceneMaterial material;
+        material.shininess = shininess;
+        if (texture) {
+            this->addTexture(material, texture, "texture_diffuse1");
+            if (specular)
+                this->addTexture(material, texture, "texture_specular1");
+        }
+        this->materials.push_back(material);
+        return (unsigned int)this->materials.size() - 1;
+    }
+
+    // places a model, returns the instance index
+    unsigned int addInstance(unsigned int model, unsigned int material, const glm::mat4 &transform)
+    {
+        SceneInstance instance = this->instance(material, transform);
+        instance.model = (int)model;
+        this->instances.push_back(instance);
+        return (unsigned int)this->instances.size() - 1;
+    }
+
+    // places a vertex array drawn as vertices triangles, returns the instance index
+    unsigned int addInstance(GLuint vertexArray, GLsizei vertices, unsigned int material, const glm::mat4 &transform)
+    {
+        SceneInstance instance = this->instance(material, transform);
+        instance.vertexArray = vertexArray;
+        instance.vertices = vertices;
+        this->instances.push_back(instance);
+        return (unsigned int)this->instances.size() - 1;
+    }
+
+    // draws the lit instances with their materials, the shader is in use and reads the shadow
+    // map from SHADOW_MAP_UNIT
+    void draw(const Shader &shader, GLuint shadowMap, float rotationAngle, bool mirror) const
+    {
+        for (unsigned int i = 0; i < this->instances.size(); i++) {
+            const SceneInstance &instance = this->instances[i];
+            if (!instance.lit || (mirror && instance.hiddenWithMirror))
+                continue;
+            const SceneMaterial &material = this->materials[instance.material];
+            shader.setFloat("material.shininess", material.shininess);
+            material.textures.bind(shader);
+            // a model's own textures may have taken the unit, dropped by GLState when not
+            glState().bindTexture(SHADOW_MAP_UNIT, GL_TEXTURE_2D, shadowMap);
+            this->drawInstance(shader, i, rotationAngle);
+        }
+    }
+
+    // draws the geometry of the shadow casters, the depth shader is in use
+    void drawDepth(const Shader &shader, float rotationAngle) const
+    {
+        for (unsigned int i = 0; i < this->instances.size(); i++) {
+            const SceneInstance &instance = this->instances[i];
+            if (!instance.castsShadow)
+                continue;
+            shader.setMat4("model", this->transformOf(instance, rotationAngle));
+            this->drawGeometry(instance);
+        }
+    }
+
+    // sets the model matrix and draws one instance with the textures of its model
+    void drawInstance(const Shader &shader, unsigned int i, float rotationAngle) const
+    {
+        const SceneInstance &instance = this->instances[i];
+        shader.setMat4("model", this->transformOf(instance, rotationAngle));
+        if (instance.model < 0) {
+            this->drawGeometry(instance);
+            return;
+        }
+        this->models[instance.model].Draw(shader);
+    }
+
+    void deleteBuffers()
+    {
+        for (unsigned int i = 0; i < this->models.size(); i++)
+            this->models[i].deleteBuffers();
+        this->particles.deleteBuffers();
+        glState().invalidate(); // some of the deleted objects were bound
+    }
+
+private:
+    SceneInstance instance(unsigned int material, const glm::mat4 &transform) const
+    {
+        SceneInstance instance;
+        instance.model = -1;
+        instance.vertexArray = 0;
+        instance.vertices = 0;
+        instance.material = material;
+        instance.transform = transform;
+        instance.spins = false;
+        instance.lit = true;
+        instance.castsShadow = true;
+        instance.hiddenWithMirror = false;
+        return instance;
+    }
+
+    void addTexture(SceneMaterial &material, GLuint texture, const char *sampler) const
+    {
+        MaterialTexture binding;
+        binding.unit = 0;
+        binding.texture = texture;
+        binding.sampler = sampler;
+        material.textures.textures.push_back(binding);
+    }
+
+    glm::mat4 transformOf(const SceneInstance &instance, float rotationAngle) const
+    {
+        if (!instance.spins)
+            return instance.transform;
+        return glm::rotate(instance.transform, rotationAngle, glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+
+    void drawGeometry(const SceneInstance &instance) const
+    {
+        if (instance.model >= 0) {
+            this->models[instance.model].DrawElements();
+            return;
+        }
+        glState().bindVertexArray(instance.vertexArray);
+        glDrawArrays(GL_TRIANGLES, 0, instance.vertices);
+    }
+};
+#endif
@@ -0,0 +1,191 @@
+#ifndef SCENE_UNIFORMS_H
+#define SCENE_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <learnopengl/shader_m.h>
+
+#include <cstring>
+#include <vector>
+
+// fixed binding points of the uniform blocks shared by every scene program
+enum SceneUniformBinding {
+    SCENE_BINDING_CAMERA = 0, // "Camera": projection, view, viewPos
+    SCENE_BINDING_LIGHTS = 1, // "Lights": dirLight, pointLights[]
+    SCENE_BINDING_SHADOW = 2  // "Shadow": lightSpaceMatrix
+};
+
+const int SCENE_POINT_LIGHTS = 4; // NR_POINT_LIGHTS of multiple_lights.fs
+
+// C++ mirrors of the std140 blocks, a vec3 always takes a 16 byte slot so the float that
+// follows each one fills its fourth component
+struct CameraBlock {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPos;
+    float padding;
+};
+
+struct DirLightBlock {
+    glm::vec3 direction;
+    float padding0;
+    glm::vec3 ambient;
+    float padding1;
+    glm::vec3 diffuse;
+    float padding2;
+    glm::vec3 specular;
+    float padding3;
+};
+
+struct PointLightBlock {
+    glm::vec3 position;
+    float constant;
+    glm::vec3 ambient;
+    float linear;
+    glm::vec3 diffuse;
+    float quadratic;
+    glm::vec3 specular;
+    float padding;
+};
+
+struct LightsBlock {
+    DirLightBlock dirLight;
+    PointLightBlock pointLights[SCENE_POINT_LIGHTS];
+};
+
+struct ShadowBlock {
+    glm::mat4 lightSpaceMatrix;
+};
+
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock must match the std140 Camera block");
+static_assert(sizeof(LightsBlock) == 320, "LightsBlock must match the std140 Lights block");
+static_assert(sizeof(ShadowBlock) == 64, "ShadowBlock must match the std140 Shadow block");
+
+// The uniforms every scene program shares, kept in one uniform buffer per block and bound to
+// fixed binding points once. A program is attached once after linking and from then on reads
+// them without any per-draw upload: the camera is written once per view, and the lights and
+// the shadow matrix only when they change, and then only the bytes that did.
+class SceneUniforms
+{
+public:
+    SceneUniforms()
+    {
+        this->cameraUBO = this->createBuffer(SCENE_BINDING_CAMERA, sizeof(CameraBlock));
+        this->lightsUBO = this->createBuffer(SCENE_BINDING_LIGHTS, sizeof(LightsBlock));
+        this->shadowUBO = this->createBuffer(SCENE_BINDING_SHADOW, sizeof(ShadowBlock));
+        memset(&this->lights, 0, sizeof(this->lights));
+        memset(&this->shadow, 0, sizeof(this->shadow));
+    }
+
+    // Points the blocks the program declares at the shared buffers; the others are skipped.
+    void attach(const Shader &shader) const
+    {
+        this->bindBlock(shader.ID, "Camera", SCENE_BINDING_CAMERA);
+        this->bindBlock(shader.ID, "Lights", SCENE_BINDING_LIGHTS);
+        this->bindBlock(shader.ID, "Shadow", SCENE_BINDING_SHADOW);
+    }
+
+    // once per view: the screen, or every face of the mirror cubemap
+    void setCamera(const glm::mat4 &projection, const glm::mat4 &view, const glm::vec3 &viewPos)
+    {
+        CameraBlock camera;
+        camera.projection = projection;
+        camera.view = view;
+        camera.viewPos = viewPos;
+        camera.padding = 0.0f;
+        glBindBuffer(GL_UNIFORM_BUFFER, this->cameraUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(camera), &camera);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void setDirectionalLight(const glm::vec3 &direction, const glm::vec3 &ambient, const glm::vec3 &diffuse, const glm::vec3 &specular)
+    {
+        LightsBlock next = this->lights;
+        next.dirLight.direction = direction;
+        next.dirLight.ambient = ambient;
+        next.dirLight.diffuse = diffuse;
+        next.dirLight.specular = specular;
+        this->updateLights(next);
+    }
+
+    // point lights with the attenuation of a ~50 m range and an ambient term of 10% of the color
+    void setPointLights(const glm::vec3 positions[], const glm::vec3 colors[], int count)
+    {
+        LightsBlock next = this->lights;
+        for (int i = 0; i < count && i < SCENE_POINT_LIGHTS; i++) {
+            PointLightBlock &light = next.pointLights[i];
+            light.position = positions[i];
+            light.ambient = colors[i] * 0.1f;
+            light.diffuse = colors[i];
+            light.specular = colors[i];
+            light.constant = 1.0f;
+            light.linear = 0.09f;
+            light.quadratic = 0.032f;
+        }
+        this->updateLights(next);
+    }
+
+    void setShadow(const glm::mat4 &lightSpaceMatrix)
+    {
+        ShadowBlock next;
+        next.lightSpaceMatrix = lightSpaceMatrix;
+        this->upload(this->shadowUBO, &this->shadow, &next, sizeof(next));
+    }
+
+    void deleteBuffers()
+    {
+        glDeleteBuffers(1, &this->cameraUBO);
+        glDeleteBuffers(1, &this->lightsUBO);
+        glDeleteBuffers(1, &this->shadowUBO);
+    }
+
+private:
+    GLuint cameraUBO, lightsUBO, shadowUBO;
+    // what the light and shadow buffers hold
+    LightsBlock lights;
+    ShadowBlock shadow;
+
+    GLuint createBuffer(SceneUniformBinding binding, GLsizeiptr size)
+    {
+        // zeroed, like the CPU copies upload() compares against
+        std::vector<unsigned char> zeros(size, 0);
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, size, zeros.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+        return buffer;
+    }
+
+    void bindBlock(GLuint program, const char *name, SceneUniformBinding binding) const
+    {
+        GLuint index = glGetUniformBlockIndex(program, name);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, binding);
+    }
+
+    void updateLights(const LightsBlock &next)
+    {
+        this->upload(this->lightsUBO, &this->lights, &next, sizeof(next));
+    }
+
+    // Writes the 16 byte slots between the first and the last one that differ from the
+    // current contents, or nothing when they are all equal.
+    void upload(GLuint buffer, void *current, const void *next, size_t size)
+    {
+        const unsigned char *a = (const unsigned char*)current, *b = (const unsigned char*)next;
+        size_t begin = 0, end = size;
+        while (begin < size && memcmp(a + begin, b + begin, 16) == 0)
+            begin += 16;
+        if (begin == size)
+            return;
+        while (memcmp(a + end - 16, b + end - 16, 16) == 0)
+            end -= 16;
+        memcpy((unsigned char*)current + begin, b + begin, end - begin);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, begin, end - begin, b + begin);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+};
+#endif
@@ -1,7 +1,10 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 lightSpaceMatrix;
+layout (std140) uniform Shadow {
+    mat4 lightSpaceMatrix;
+};
+
 uniform mat4 model;
 
 void main()
@@ -0,0 +1,133 @@
+#ifndef TRANSPARENCY_H
+#define TRANSPARENCY_H
+
+#include <glad/glad.h>
+#include <learnopengl/gl_state.h>
+#include <learnopengl/shader_m.h>
+
+#include <iostream>
+
+// how the translucent geometry (glass walls and particles) is composited over the scene
+enum TransparencyMode {
+    TRANSPARENCY_BLENDED,     // over operator straight into the screen, correct only in back-to-front order
+    TRANSPARENCY_WEIGHTED_OIT // weighted blended order independent transparency, any draw order
+};
+
+// Weighted blended order independent transparency (McGuire & Bavoil 2013).
+//
+// Translucent surfaces are drawn in any order into two offscreen targets: an RGBA16F
+// accumulation target summing premultiplied color * weight in rgb and multiplying the
+// revealage (1 - alpha) in a, and an R16F target summing alpha * weight. The weight falls off
+// with depth so near surfaces dominate. resolve() divides the sums and blends the average
+// color over the opaque image by the revealage in a single fullscreen pass.
+//
+// Both targets use the same blend equation split by glBlendFuncSeparate, so it runs on plain
+// GL 3.3 without per draw buffer blending. The opaque depth is blitted in so translucent
+// fragments behind solid geometry are still rejected. glass.fs and particle.fs switch to the
+// two weighted outputs when their "weightedOIT" uniform is set.
+class WeightedBlendedOIT
+{
+public:
+    unsigned int width, height;
+
+    WeightedBlendedOIT(unsigned int width, unsigned int height)
+        : width(width), height(height), composite("fullscreen.vs", "oit_composite.fs")
+    {
+        glGenFramebuffers(1, &this->FBO);
+        glState().bindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+
+        this->accumTexture = this->createTarget(GL_RGBA16F, GL_RGBA);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->accumTexture, 0);
+        this->weightTexture = this->createTarget(GL_R16F, GL_RED);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, this->weightTexture, 0);
+        GLenum buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, buffers);
+
+        // same format as the default framebuffer's depth so it can be blitted
+        glGenRenderbuffers(1, &this->depthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->depthRBO);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: OIT framebuffer is not complete!" << std::endl;
+        glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // the composite pass makes its fullscreen triangle from gl_VertexID
+        glGenVertexArrays(1, &this->emptyVAO);
+        this->composite.use();
+        this->composite.setInt("accumTexture", 0);
+        this->composite.setInt("weightTexture", 1);
+    }
+
+    // Copies the opaque depth of the screen and binds the cleared accumulation targets with
+    // depth writes off and the weighted blend equation. Draw the translucent geometry with
+    // its shaders' "weightedOIT" uniform set to true, in any order, then call resolve().
+    void begin()
+    {
+        glState().bindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glState().bindFramebuffer(GL_DRAW_FRAMEBUFFER, this->FBO);
+        glBlitFramebuffer(0, 0, this->width, this->height, 0, 0, this->width, this->height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glState().bindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+
+        const GLfloat noColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f }; // nothing accumulated, fully revealed
+        const GLfloat noWeight[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        glClearBufferfv(GL_COLOR, 0, noColor);
+        glClearBufferfv(GL_COLOR, 1, noWeight);
+
+        glState().enable(GL_DEPTH_TEST);
+        glState().depthMask(GL_FALSE);
+        glState().enable(GL_BLEND);
+        // rgb: sum of color * alpha * weight, a: product of (1 - alpha)
+        glState().blendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    // Blends the averaged translucent color over the screen and restores the default state.
+    void resolve()
+    {
+        glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+        glState().depthMask(GL_TRUE);
+        glState().disable(GL_DEPTH_TEST);
+        glState().blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        this->composite.use();
+        glState().activeTexture(GL_TEXTURE0);
+        glState().bindTexture(GL_TEXTURE_2D, this->accumTexture);
+        glState().activeTexture(GL_TEXTURE1);
+        glState().bindTexture(GL_TEXTURE_2D, this->weightTexture);
+        glState().bindVertexArray(this->emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glState().bindVertexArray(0);
+        glState().activeTexture(GL_TEXTURE0);
+
+        glState().enable(GL_DEPTH_TEST);
+    }
+
+    void deleteBuffers()
+    {
+        glDeleteVertexArrays(1, &this->emptyVAO);
+        glDeleteTextures(1, &this->accumTexture);
+        glDeleteTextures(1, &this->weightTexture);
+        glDeleteRenderbuffers(1, &this->depthRBO);
+        glDeleteFramebuffers(1, &this->FBO);
+    }
+
+private:
+    GLuint FBO, accumTexture, weightTexture, depthRBO, emptyVAO;
+    Shader composite;
+
+    GLuint createTarget(GLint internalFormat, GLenum format)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glState().bindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, this->width, this->height, 0, format, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glState().bindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+};
+#endif
@@ -6,12 +6,22 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <learnopengl/filesystem.h>
+#include <learnopengl/gl_state.h>
 #include <learnopengl/shader_m.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
-
-#include "particle_container.cpp"
-
+#include <learnopengl/model_loader.h>
+#include <learnopengl/texture_streamer.h>
+#include <learnopengl/thread_pool.h>
+#include <learnopengl/gpu_timer.h>
+
+#include "particle_offscreen.h"
+#include "particle_system.h"
+#include "scene.h"
+#include "scene_uniforms.h"
+#include "transparency.h"
+
+#include <chrono>
 #include <iostream>
 
 // Function prototypes
@@ -21,13 +31,11 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
 unsigned int loadCubemap(vector<std::string> faces);
 
-void drawScene(Shader ourShader, Shader metal, Shader glassShader, Shader skyboxShader, Shader lampShader, Shader groundShader, unsigned int skyboxVAO,
- unsigned int cubeVAO, unsigned int planeVAO, unsigned int roofVAO, unsigned int glassWallsVAO, unsigned int cubemapTexture, unsigned int woodTexture, unsigned int marmolTexture,unsigned int woodTableTexture, 
- unsigned int roofTexture, glm::vec3 lightPos[], glm::vec3 lightColor[], Camera camera, Model ship, Model nanoSuitModel,
- Model sphere_mirrow, Model table, Model fountain, Model computer, float fov, float aspectRatio, glm::mat4 lightSpaceMatrix,  unsigned int depthMap, float rotationAngle);
+void drawScene(const Scene &scene, SceneUniforms &sceneUniforms, const Shader &ourShader, const Shader &skyboxShader, const Shader &lampShader,
+ const Camera &camera, float fov, float aspectRatio, unsigned int depthMap, float rotationAngle);
+void drawGlass(const Shader &glassShader, unsigned int glassWallsVAO, GLsizei glassWallsVertices, unsigned int cubemapTexture, bool weightedOIT);
 
- void drawSceneDepth(Shader shader, unsigned int planeVAO, glm::vec3 lightPos, Model ship, Model nanoSuitModel,
- Model sphere_mirrow, Model table, Model computer, Model fountain, float rotationAngle);
+ void drawSceneDepth(const Scene &scene, const Shader &shader, float rotationAngle);
 
  unsigned int loadCubemap(unsigned int faces);
  unsigned int createEmptyCubemap(int size);
@@ -36,13 +44,45 @@ void checkFBOStatus();
 unsigned int loadTexture(char const * path);
 unsigned int getEmptyTexture(unsigned int width, unsigned int height);
 void renderQuad();
-void setLights(Shader shader, glm::vec3 lightPositions[], glm::vec3 lightColors[], glm::mat4 lightSpaceMatrix, unsigned int depthMap, int nrLights);
 void getLightColors(glm::vec3 *pointLightColors);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
+// shadow map taps of the lit objects: (2 * radius + 1)^2
+const int SHADOW_PCF_RADIUS = 1;
+const unsigned int NR_PARTICLES = 5000;
+// live particles over all the visible fountains
+const unsigned int PARTICLE_BUDGET = 2 * NR_PARTICLES;
+// PARTICLE_BACKEND_GPU simulates the fountains with transform feedback
+const ParticleBackend PARTICLE_BACKEND = PARTICLE_BACKEND_CPU;
+// PARTICLE_FORMAT_COMPACT keeps the CPU particles quantized to fp16 / RGBA8
+const ParticleFormat PARTICLE_FORMAT = PARTICLE_FORMAT_FLOAT;
+// PARTICLE_DYNAMICS_SPH lets the CPU particles interact as a fluid (float format only)
+const ParticleDynamics PARTICLE_DYNAMICS = PARTICLE_DYNAMICS_BALLISTIC;
+// every fountain gets its own seed, the same seed replays the same particles
+const unsigned int PARTICLE_SEED = 1;
+// PARTICLE_CACHE_RECORD bakes the CPU fountains into fountain<n>.pcache while they run,
+// PARTICLE_CACHE_PLAY plays those files back in a loop instead of simulating
+const ParticleCacheMode PARTICLE_CACHE_MODE = PARTICLE_CACHE_OFF;
+// samples per second baked into the caches, playback interpolates between them
+const float PARTICLE_CACHE_RATE = 30.0f;
+// TRANSPARENCY_BLENDED draws the glass and the particles straight into the screen, in draw order
+const TransparencyMode TRANSPARENCY_MODE = TRANSPARENCY_WEIGHTED_OIT;
+// HALF / QUARTER shade the particles off-screen at a lower resolution and upsample them;
+// they are then depth sorted and composited over the glass instead of accumulated with it
+const ParticleResolution PARTICLE_RESOLUTION = PARTICLE_RESOLUTION_FULL;
+// linked programs are cached here and loaded back on the next launch, "" compiles every time
+const char* const SHADER_CACHE_DIRECTORY = "shader_cache";
+// imported models are cached here and mapped back on the next launch, "" imports every time
+const char* const MESH_CACHE_DIRECTORY = "mesh_cache";
+// false links every program before compiling the next one, to compare the startup time
+const bool PARALLEL_SHADER_COMPILE = true;
+// false decodes and uploads every texture before the next one is loaded, to compare
+const bool STREAM_TEXTURES = true;
+// seconds between two reports of the GPU time of the translucent pass
+const float TRANSLUCENT_TIMING_INTERVAL = 2.0f;
 
 // camera
 Camera camera(glm::vec3(6.5f, 2.0f, -6.8f), glm::vec3(0.0f, 1.0f, 0.0f), 135, -20);
@@ -98,10 +138,21 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    if (SHADER_CACHE_DIRECTORY[0] != '\0')
+        ProgramBinaryCache::instance().enable(SHADER_CACHE_DIRECTORY);
+    if (MESH_CACHE_DIRECTORY[0] != '\0')
+        MeshCache::instance().enable(MESH_CACHE_DIRECTORY);
+    if (PARALLEL_SHADER_COMPILE)
+        ParallelShaderCompile::instance().enable((GLADloadproc)glfwGetProcAddress);
+    // the model imports and the texture decodes share one pool, so loading starts no more
+    // threads than there are cores; the particles' pool only works once the render loop runs
+    ThreadPool loaderPool;
+    if (STREAM_TEXTURES)
+        TextureStreamer::instance().enable(loaderPool);
 
     // configure global opengl state
     // -----------------------------
-    glEnable(GL_DEPTH_TEST);
+    glState().enable(GL_DEPTH_TEST);
     // glEnable(GL_CULL_FACE);  
 
     // used to rotate nanosut and ship
@@ -110,34 +161,91 @@ int main()
     // -------------------------
     // BUILD AND COMPILE SHADERS
     // -------------------------
-    Shader ourShader("multiple_lights.vs", "multiple_lights.fs");
-    Shader skyboxShader("cubemap.vs", "cubemap.fs");
-    Shader lampShader("lamp.vs", "lamp.fs");
-    Shader metal("metal.vs", "metal.fs");
-    Shader glassShader("glass.vs", "glass.fs");
-    Shader screenShader("framebuffers_screen.vs", "framebuffers_screen.fs");
-    Shader simpleDepthShader("shadow_mapping_depth.vs", "shadow_mapping_depth.fs");
-    Shader debugDepthQuad("debug_quad.vs", "debug_quad.fs");
-    Shader groundShader("ground.vs", "ground.fs");
-    Shader particleShader("particle.vs", "particle.fs");
+    // every program is submitted before any of them is waited on; the scene ones are linked
+    // before the first frame, the particles may still be compiling while it is drawn
+    ShaderLink shaderLink = PARALLEL_SHADER_COMPILE ? SHADER_LINK_DEFERRED : SHADER_LINK_NOW;
+    ShaderBatch sceneShaders(shaderLink, "scene shaders");
+    ShaderBatch particleShaders(shaderLink, "particle shaders");
+    Shader particleShader = particleShaders.add("particle.vs", "particle.fs");
+    Shader skyboxShader = sceneShaders.add("cubemap.vs", "cubemap.fs");
+    Shader lampShader = sceneShaders.add("lamp.vs", "lamp.fs");
+    Shader metal = sceneShaders.add("metal.vs", "metal.fs");
+    Shader glassShader = sceneShaders.add("glass.vs", "glass.fs");
+    Shader screenShader = sceneShaders.add("framebuffers_screen.vs", "framebuffers_screen.fs");
+    Shader simpleDepthShader = sceneShaders.add("shadow_mapping_depth.vs", "shadow_mapping_depth.fs");
+    Shader debugDepthQuad = sceneShaders.add("debug_quad.vs", "debug_quad.fs");
+    Shader groundShader = sceneShaders.add("ground.vs", "ground.fs");
+    // the lit objects get a program specialized for each pass: the mirror faces are small and
+    // drawn six times, they skip the shadows and the highlights
+    ShaderVariants litShaders("multiple_lights.vs", "multiple_lights.fs", &sceneShaders);
+    Shader ourShader = litShaders.get(ShaderDefines()
+        .set("NR_POINT_LIGHTS", SCENE_POINT_LIGHTS).set("SHADOWS", 1).set("PCF_RADIUS", SHADOW_PCF_RADIUS).set("SPECULAR", 1));
+    Shader mirrorShader = litShaders.get(ShaderDefines()
+        .set("NR_POINT_LIGHTS", SCENE_POINT_LIGHTS).set("SHADOWS", 0).set("SPECULAR", 0));
+    // prints how long the scene programs took
+    sceneShaders.finish();
+
+    // camera, lights and shadow matrix shared by the scene programs through uniform blocks;
+    // attaching asks GL about the program, so only linked ones are attached
+    SceneUniforms sceneUniforms;
+    litShaders.onBuild = [&sceneUniforms](const Shader &shader) { sceneUniforms.attach(shader); };
+    sceneUniforms.attach(ourShader);
+    sceneUniforms.attach(mirrorShader);
+    sceneUniforms.attach(skyboxShader);
+    sceneUniforms.attach(lampShader);
+    sceneUniforms.attach(metal);
+    sceneUniforms.attach(glassShader);
+    sceneUniforms.attach(simpleDepthShader);
+    sceneUniforms.attach(groundShader);
+    sceneUniforms.setDirectionalLight(glm::vec3(-0.2f, -1.0f, -0.3f), glm::vec3(0.0f), glm::vec3(0.05f), glm::vec3(0.2f));
 
     // --------------------
     // PARTICLE SYSTEM INITIALIZATION
     // ---------------------
-    ParticleContainer* particleContainer = new ParticleContainer(particleShader, glm::vec3(4.5f, 1.0f, 0));
-    particleContainer->initBuffers();
-
-    ParticleContainer* particleContainer2 = new ParticleContainer(particleShader, glm::vec3(-4.5f, 1.0f, 0));
-    particleContainer2->initBuffers();
+    // the room: models, materials, instances, lights and the fountains' emitters
+    Scene scene(PARTICLE_BUDGET);
+    scene.particles.add(new ParticleContainer(particleShader, glm::vec3(4.5f, 1.0f, 0), NR_PARTICLES, PARTICLE_BACKEND, PARTICLE_SEED, PARTICLE_FORMAT));
+    scene.particles.add(new ParticleContainer(particleShader, glm::vec3(-4.5f, 1.0f, 0), NR_PARTICLES, PARTICLE_BACKEND, PARTICLE_SEED + 1, PARTICLE_FORMAT));
+    scene.particles.setDynamics(PARTICLE_DYNAMICS);
+    // no depth sort is needed when the particles are accumulated order independently
+    bool offscreenParticles = PARTICLE_RESOLUTION != PARTICLE_RESOLUTION_FULL;
+    if (TRANSPARENCY_MODE == TRANSPARENCY_WEIGHTED_OIT && !offscreenParticles)
+        scene.particles.setBlend(PARTICLE_BLEND_WEIGHTED_OIT);
+    std::vector<ParticleCacheWriter*> particleCaches;
+    for (unsigned int e = 0; e < scene.particles.emitters.size(); e++) {
+        ParticleContainer* fountain = scene.particles.emitters[e];
+        std::string cachePath = "fountain" + std::to_string(e) + ".pcache";
+        if (PARTICLE_CACHE_MODE == PARTICLE_CACHE_PLAY)
+            fountain->playFrom(cachePath);
+        if (PARTICLE_CACHE_MODE == PARTICLE_CACHE_RECORD) {
+            particleCaches.push_back(new ParticleCacheWriter());
+            particleCaches.back()->open(cachePath, PARTICLE_CACHE_RATE, fountain->posInit);
+        }
+    }
 
-    // load models
+    // --------------------
+    // TRANSLUCENT PASS
+    // ---------------------
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    WeightedBlendedOIT oit(framebufferWidth, framebufferHeight);
+    // the scene depth is drawn with drawScene's projection
+    OffscreenParticles* lowResParticles = NULL;
+    if (offscreenParticles)
+        lowResParticles = new OffscreenParticles(framebufferWidth, framebufferHeight, PARTICLE_RESOLUTION, 0.1f, 200.0f);
+    GpuTimer translucentTimer;
+    float lastTimingReport = 0.0f;
+
+    // load models: imported on workers while the textures and buffers below are created, and
+    // uploaded once those are done
     // -----------
-    Model ship(FileSystem::getPath("resources/objects/ship/99-intergalactic_spaceship-obj-1/Intergalactic_Spaceship-(Wavefront).obj"));
-    Model nanoSuitModel(FileSystem::getPath("resources/objects/nanosuit/nanosuit.obj"));
-    Model table(FileSystem::getPath("resources/objects/table/table.obj"));
-    Model sphere_mirrow(FileSystem::getPath("resources/objects/ball/13517_Beach_Ball_v2_L3.obj"));
-    Model fountain(FileSystem::getPath("resources/objects/angel/angel.obj"));
-    Model computer(FileSystem::getPath("resources/objects/notebook/Lowpoly_Notebook_2.obj"));
+    std::unique_ptr<ModelLoader> modelLoader(new ModelLoader(scene.models, loaderPool));
+    unsigned int ship = modelLoader->add(FileSystem::getPath("resources/objects/ship/99-intergalactic_spaceship-obj-1/Intergalactic_Spaceship-(Wavefront).obj"));
+    unsigned int nanoSuitModel = modelLoader->add(FileSystem::getPath("resources/objects/nanosuit/nanosuit.obj"));
+    unsigned int table = modelLoader->add(FileSystem::getPath("resources/objects/table/table.obj"));
+    unsigned int sphere_mirrow = modelLoader->add(FileSystem::getPath("resources/objects/ball/13517_Beach_Ball_v2_L3.obj"));
+    unsigned int fountain = modelLoader->add(FileSystem::getPath("resources/objects/angel/angel.obj"));
+    unsigned int computer = modelLoader->add(FileSystem::getPath("resources/objects/notebook/Lowpoly_Notebook_2.obj"));
     
     // load textures
     // -------------
@@ -295,42 +403,42 @@ int main()
     unsigned int cubeVAO, cubeVBO;
     glGenVertexArrays(1, &cubeVAO);
     glGenBuffers(1, &cubeVBO);
-    glBindVertexArray(cubeVAO);
+    glState().bindVertexArray(cubeVAO);
     glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glBindVertexArray(0);
+    glState().bindVertexArray(0);
 
     // skybox VAO
     unsigned int skyboxVAO, skyboxVBO;
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
+    glState().bindVertexArray(skyboxVAO);
     glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glBindVertexArray(0);
+    glState().bindVertexArray(0);
 
     // screen quad VAO
     unsigned int quadVAO, quadVBO;
     glGenVertexArrays(1, &quadVAO);
     glGenBuffers(1, &quadVBO);
-    glBindVertexArray(quadVAO);
+    glState().bindVertexArray(quadVAO);
     glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
-    glBindVertexArray(0);
+    glState().bindVertexArray(0);
 
     // plane VAO
     unsigned int planeVBO, planeVAO;
     glGenVertexArrays(1, &planeVAO);
     glGenBuffers(1, &planeVBO);
-    glBindVertexArray(planeVAO);
+    glState().bindVertexArray(planeVAO);
     glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), &planeVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -339,13 +447,13 @@ int main()
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glBindVertexArray(0);
+    glState().bindVertexArray(0);
 
     // roof VAO
     unsigned int roofVBO, roofVAO;
     glGenVertexArrays(1, &roofVAO);
     glGenBuffers(1, &roofVBO);
-    glBindVertexArray(roofVAO);
+    glState().bindVertexArray(roofVAO);
     glBindBuffer(GL_ARRAY_BUFFER, roofVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(roofVertices), &roofVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -354,13 +462,14 @@ int main()
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glBindVertexArray(0);
+    glState().bindVertexArray(0);
 
     // glass wall VAO
     unsigned int glassVBO, glassVAO;
+    const GLsizei glassVertices = sizeof(glassWallVertices) / (8 * sizeof(float));
     glGenVertexArrays(1, &glassVAO);
     glGenBuffers(1, &glassVBO);
-    glBindVertexArray(glassVAO);
+    glState().bindVertexArray(glassVAO);
     glBindBuffer(GL_ARRAY_BUFFER, glassVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(glassWallVertices), &glassWallVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
@@ -369,7 +478,80 @@ int main()
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glBindVertexArray(0);
+    glState().bindVertexArray(0);
+
+    // ------------------------------------
+    // SCENE: MATERIALS, INSTANCES AND LIGHTS
+    // ------------------------------------
+    modelLoader->finish();
+    modelLoader->report();
+    MeshCache::instance().report();
+    if (!STREAM_TEXTURES)
+        TextureStreamer::instance().report(); // every texture is loaded by now
+    modelLoader.reset();
+    unsigned int plain = scene.addMaterial(32.0f);
+    unsigned int tableMaterial = scene.addMaterial(32.0f, woodTableTexture, true);
+    unsigned int computerMaterial = scene.addMaterial(32.0f, marmolTexture, true);
+    unsigned int woodFountain = scene.addMaterial(32.0f, woodTableTexture);
+    unsigned int marmolFountain = scene.addMaterial(32.0f, marmolTexture);
+    unsigned int floorMaterial = scene.addMaterial(128.0f, woodTexture, true);
+    unsigned int roofMaterial = scene.addMaterial(128.0f, roofTexture);
+
+    glm::mat4 model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(0.0f, -1.7f, 4.5f));
+    model = glm::scale(model, glm::vec3(0.4f, 0.4f, 0.4f));
+    scene.instances[scene.addInstance(ship, plain, model)].spins = true;
+
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(0.0f, -2.0f, -4.5f));
+    model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
+    scene.instances[scene.addInstance(nanoSuitModel, plain, model)].spins = true;
+
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(-4.5f, -2.0f, 4.5f));
+    model = glm::scale(model, glm::vec3(0.15f, 0.15f, 0.15f));
+    model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0, 0.0, 0.0));
+    model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0.0, 0.0, 1.0));
+    scene.addInstance(table, tableMaterial, model);
+
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(-4.5f, -0.8f, 4.5f));
+    model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
+    model = glm::rotate(model, glm::radians(-180.0f), glm::vec3(0.0, 1.0, 0.0));
+    scene.instances[scene.addInstance(computer, computerMaterial, model)].hiddenWithMirror = true;
+
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(4.5f, -2.0f, 0.0f));
+    model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0, 0.0, 0.0));
+    model = glm::scale(model, glm::vec3(0.15f, 0.15f, 0.15f));
+    scene.addInstance(fountain, woodFountain, model);
+
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(-4.5f, -2.0f, 0.0f));
+    model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0, 0.0, 0.0));
+    model = glm::scale(model, glm::vec3(0.15f, 0.15f, 0.15f));
+    scene.addInstance(fountain, marmolFountain, model);
+
+    model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.5f, 0.0f));
+    scene.addInstance(planeVAO, 6, floorMaterial, model);
+
+    model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 5.0f, 0.0f));
+    scene.instances[scene.addInstance(roofVAO, 18, roofMaterial, model)].castsShadow = false;
+
+    // drawn with the dynamic cubemap by the metal program after the rest of the scene
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(0.0f, 0.3f, 0.0f));
+    model = glm::scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
+    unsigned int mirrorBall = scene.addInstance(sphere_mirrow, plain, model);
+    scene.instances[mirrorBall].lit = false;
+
+    // the first light orbits the room and is placed every frame
+    scene.lightPositions[1] = glm::vec3(6.8f, 1.0f, -6.8f);
+    scene.lightPositions[2] = glm::vec3(0.0f, 1.0, 6.8f);
+    scene.lightPositions[3] = glm::vec3(-6.8f, 1.0, -6.8f);
+    scene.lampVertexArray = cubeVAO;
+    scene.skyboxVertexArray = skyboxVAO;
+    scene.skyboxTexture = cubemapTexture;
 
     screenShader.use();
     screenShader.setInt("screenTexture", 0);
@@ -378,7 +560,7 @@ int main()
     // -------------------------
     unsigned int framebuffer;
     glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
     glDrawBuffer(GL_COLOR_ATTACHMENT0);
     // used for debugging only in mirrowing.
     unsigned int textureColorbuffer;
@@ -399,7 +581,7 @@ int main()
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << endl;
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
 
     // ------------------
     // Depth Frame Buffer
@@ -407,11 +589,11 @@ int main()
     unsigned int depthMapFBO;
     glGenFramebuffers(1, &depthMapFBO);
     unsigned int depthMap = getEmptyTexture(SHADOW_WIDTH, SHADOW_HEIGHT);
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+    glState().bindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);  
+    glState().bindFramebuffer(GL_FRAMEBUFFER, 0);  
     
     // render loop
     // -----------
@@ -434,23 +616,34 @@ int main()
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        // picks up the programs that finished compiling, the cache counts them all once done
+        if (particleShaders.poll())
+            ProgramBinaryCache::instance().report();
+        // uploads the textures decoded meanwhile, placeholders are drawn until then
+        if (TextureStreamer::instance().update())
+            TextureStreamer::instance().report();
+
         // ---------------------------------------
         // Configure lighting: color and positions
         // ---------------------------------------
         const float radius = 2.5f;
-        glm::vec3 pointLightColors[4];
-        getLightColors(pointLightColors);
-        glm::vec3 pointLightPos[] = {
-            glm::vec3(sin(glfwGetTime()) * radius, 4.0f, cos(glfwGetTime()) * radius),
-            glm::vec3(6.8f, 1.0f, -6.8f),
-            glm::vec3(0.0f, 1.0, 6.8f),
-            glm::vec3(-6.8f, 1.0, -6.8f)
-        };
+        getLightColors(scene.lightColors);
+        scene.lightPositions[0] = glm::vec3(sin(glfwGetTime()) * radius, 4.0f, cos(glfwGetTime()) * radius);
+        // only what changed is uploaded, the orbiting light every frame and the colors on a turn
+        sceneUniforms.setPointLights(scene.lightPositions, scene.lightColors, SCENE_POINT_LIGHTS);
 
         // input
         // -----
         processInput(window);
 
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 view = camera.GetViewMatrix();
+
+        // start simulating the particles on the worker threads, they are joined before drawing
+        if (!activateMirrow) {
+            scene.particles.simulateAsync(deltaTime, camera.Position, projection, view);
+        }
+
         // clear buffer
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -464,28 +657,28 @@ int main()
         
         // notice that ortho is used here instead of perspective.
         lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, near_plane, far_plane);
-        lightView = glm::lookAt(pointLightPos[0], glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
+        lightView = glm::lookAt(scene.lightPositions[0], glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
         lightSpaceMatrix = lightProjection * lightView;
         
+        sceneUniforms.setShadow(lightSpaceMatrix);
         simpleDepthShader.use();
-        simpleDepthShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
 
         // render important objects only.
-        glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+        glState().viewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
+        glState().bindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
         glClear(GL_DEPTH_BUFFER_BIT);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, woodTexture);
-        drawSceneDepth(simpleDepthShader, planeVAO, pointLightPos[0], ship, nanoSuitModel, sphere_mirrow, table, computer, fountain, glm::radians((float)rotationAngle));
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glState().activeTexture(GL_TEXTURE0);
+        glState().bindTexture(GL_TEXTURE_2D, woodTexture);
+        drawSceneDepth(scene, simpleDepthShader, glm::radians((float)rotationAngle));
+        glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
 
         // -------------------------------------------------------------
         // MIRROW: RENDER TO FRAME BUFFER 6 TIMES, 1 FOR EACH FACE
         // --------------------------------------------------------------
         if (activateMirrow) {
-            glViewport(0, 0, cubemapSize, cubemapSize);
-            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-            glEnable(GL_DEPTH_TEST);
+            glState().viewport(0, 0, cubemapSize, cubemapSize);
+            glState().bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+            glState().enable(GL_DEPTH_TEST);
 
             glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -504,11 +697,9 @@ int main()
                 glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
                 // draw scene
-                drawScene(ourShader, metal, glassShader, skyboxShader, lampShader, groundShader, skyboxVAO,
-                cubeVAO, planeVAO, roofVAO, glassVAO, cubemapTexture, woodTexture, marmolTexture, woodTableTexture, roofTexture, 
-                pointLightPos, pointLightColors, invertedCam, ship, nanoSuitModel, 
-                sphere_mirrow, table, fountain, computer,
-                90, 1, lightSpaceMatrix, depthMap, glm::radians((float)rotationAngle));
+                drawScene(scene, sceneUniforms, mirrorShader, skyboxShader, lampShader, invertedCam,
+                90, 1, depthMap, glm::radians((float)rotationAngle));
+                drawGlass(glassShader, glassVAO, glassVertices, cubemapTexture, false);
             }
         }
 
@@ -517,8 +708,8 @@ int main()
         // --------------------------------
 
         // reset viewport and clear buffer
-        glViewport(0, 0, SCR_WIDTH*2, SCR_HEIGHT*2);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glState().viewport(0, 0, SCR_WIDTH*2, SCR_HEIGHT*2);
+        glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // ---------------------------------------------
@@ -537,51 +728,69 @@ int main()
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 model = glm::mat4(1.0f);
-
-        drawScene(ourShader, metal, glassShader, skyboxShader, lampShader, groundShader, skyboxVAO,
-        cubeVAO, planeVAO, roofVAO, glassVAO, cubemapTexture, woodTexture, marmolTexture, woodTableTexture, roofTexture, 
-        pointLightPos, pointLightColors, camera, ship, nanoSuitModel, 
-        sphere_mirrow, table, fountain, computer,
-         camera.Zoom, (float)SCR_WIDTH / (float)SCR_HEIGHT, lightSpaceMatrix, depthMap, glm::radians((float)rotationAngle));
-
-        // ____________________________________________
-        // DRAW TWO SET OF PARTICLES
-        // ____________________________________________
-        if (!activateMirrow) {
-            particleContainer->generateParticles(deltaTime);
-            particleContainer->simulateParticles(deltaTime);
-            particleContainer->draw(waterTexture, projection, view);
-
-            particleContainer2->generateParticles(deltaTime);
-            particleContainer2->simulateParticles(deltaTime);
-            particleContainer2->draw(waterTexture, projection, view);
-        }
+        drawScene(scene, sceneUniforms, ourShader, skyboxShader, lampShader, camera,
+         camera.Zoom, (float)SCR_WIDTH / (float)SCR_HEIGHT, depthMap, glm::radians((float)rotationAngle));
 
         // ---------------------------------------------------------------------------------
         // USER RENDER: RENDER THE MIRROW SPHERE AND GIVE IT THE DYNAMIC CUBEMAP ENVIRONMENT
         // AS TEXTURE
         // ---------------------------------------------------------------------------------
-        glEnable(GL_DEPTH_TEST);
+        glState().enable(GL_DEPTH_TEST);
         metal.use();
-        glActiveTexture(GL_TEXTURE0);
+        glState().activeTexture(GL_TEXTURE0);
         if (activateMirrow){
-            glBindTexture(GL_TEXTURE_CUBE_MAP, relativeCubemapTexture);
+            glState().bindTexture(GL_TEXTURE_CUBE_MAP, relativeCubemapTexture);
         } else {
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+            glState().bindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
         }
         
         metal.setInt("skybox", 0);
-        model = glm::translate(model, glm::vec3(0.0f, 0.3f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
-        metal.setMat4("model", model);
-        metal.setMat4("view", view);
-        metal.setMat4("projection", projection);
-        metal.setVec3("cameraPos", camera.Position);
-        sphere_mirrow.Draw(metal);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        // seen through the camera block drawScene bound for the user
+        scene.drawInstance(metal, mirrorBall, glm::radians((float)rotationAngle));
+        glState().bindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+        // ____________________________________________
+        // TRANSLUCENT PASS: GLASS WALLS AND TWO SET OF PARTICLES
+        // ____________________________________________
+        // join the workers first so the timer only sees GPU work
+        if (!activateMirrow) {
+            scene.particles.wait();
+            for (unsigned int e = 0; e < particleCaches.size(); e++)
+                scene.particles.emitters[e]->recordTo(*particleCaches[e], deltaTime);
+        }
+        translucentTimer.begin();
+        bool weightedOIT = TRANSPARENCY_MODE == TRANSPARENCY_WEIGHTED_OIT;
+        if (weightedOIT)
+            oit.begin();
+        drawGlass(glassShader, glassVAO, glassVertices, cubemapTexture, weightedOIT);
+        if (!activateMirrow && !offscreenParticles)
+            scene.particles.draw(waterTexture, projection, view);
+        if (weightedOIT)
+            oit.resolve();
+        if (!activateMirrow && offscreenParticles) {
+            lowResParticles->begin();
+            scene.particles.draw(waterTexture, projection, view);
+            lowResParticles->resolve();
+        }
+        translucentTimer.end();
+
+        if (currentFrame - lastTimingReport > TRANSLUCENT_TIMING_INTERVAL && translucentTimer.sampleCount() > 0) {
+            cout << "translucent pass (" << (weightedOIT ? "weighted blended OIT" : "alpha blending");
+            if (offscreenParticles)
+                cout << ", particles at 1/" << PARTICLE_RESOLUTION << " resolution";
+            cout << "): " << translucentTimer.milliseconds() << " ms GPU" << endl;
+            for (unsigned int e = 0; e < scene.particles.emitters.size(); e++) {
+                ParticleFluid* fluid = scene.particles.emitters[e]->fluid;
+                if (fluid)
+                    cout << "fountain " << e << " SPH step: " << fluid->stats.particles << " particles, grid "
+                         << fluid->stats.gridSeconds * 1000.0 << " ms, neighbor passes " << fluid->stats.neighborSeconds * 1000.0
+                         << " ms, " << fluid->stats.particlesPerSecond << " particles/s" << endl;
+            }
+            const GLState::Stats &state = glState().lastFrame();
+            cout << "GL state: " << state.eliminated << " of " << state.calls << " state calls per frame were redundant and dropped" << endl;
+            translucentTimer.reset();
+            lastTimingReport = currentFrame;
+        }
 
         // ----------------------------------------------
         // DEBUGGING PURPOSES: FRAMEBUFFER FACING.
@@ -594,6 +803,7 @@ int main()
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
+        glState().endFrame();
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
@@ -610,7 +820,17 @@ int main()
     glDeleteBuffers(1, &planeVBO);
     glDeleteVertexArrays(1, &roofVAO);
     glDeleteBuffers(1, &roofVBO);
-    particleContainer->deleteBuffers();
+    scene.deleteBuffers();
+    sceneUniforms.deleteBuffers();
+    for (unsigned int e = 0; e < particleCaches.size(); e++)
+        delete particleCaches[e]; // writes the frame index
+    oit.deleteBuffers();
+    if (lowResParticles) {
+        lowResParticles->deleteBuffers();
+        delete lowResParticles;
+    }
+    translucentTimer.deleteQueries();
+    TextureStreamer::instance().disable();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -636,7 +856,7 @@ void renderQuad()
         // setup plane VAO
         glGenVertexArrays(1, &quadVAO);
         glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
+        glState().bindVertexArray(quadVAO);
         glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
@@ -644,9 +864,9 @@ void renderQuad()
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     }
-    glBindVertexArray(quadVAO);
+    glState().bindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
+    glState().bindVertexArray(0);
 }
 
 // change the light colors
@@ -672,266 +892,81 @@ void getLightColors(glm::vec3 *pointLightColors) {
     }
 }
 
-// Method to transmit the light parameters to the shaders
-void setLights(Shader shader, glm::vec3 lightPositions[], glm::vec3 pointLightColors[], glm::mat4 lightSpaceMatrix, unsigned int depthMap, int nrLights) {
-    // directional light
-    shader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);	
-    shader.setVec3("dirLight.ambient",  0.0f, 0.0f, 0.0f);
-    shader.setVec3("dirLight.diffuse", 0.05f, 0.05f, 0.05);
-    shader.setVec3("dirLight.specular", 0.2f, 0.2f, 0.2f);
-
-    // point lights
-    for(int i = 0; i < nrLights; i++) {
-        shader.setVec3("pointLights["+std::to_string(i)+"].position", lightPositions[i].x, lightPositions[i].y, lightPositions[i].z);
-        shader.setVec3("pointLights["+std::to_string(i)+"].ambient", pointLightColors[i].x * 0.1, pointLightColors[i].y * 0.1, pointLightColors[i].z * 0.1);
-        shader.setVec3("pointLights["+std::to_string(i)+"].diffuse", pointLightColors[i].x, pointLightColors[i].y, pointLightColors[i].z);
-        shader.setVec3("pointLights["+std::to_string(i)+"].specular", pointLightColors[i].x, pointLightColors[i].y, pointLightColors[i].z);
-        shader.setFloat("pointLights["+std::to_string(i)+"].constant", 1.0f);
-        shader.setFloat("pointLights["+std::to_string(i)+"].linear", 0.09f);
-        shader.setFloat("pointLights["+std::to_string(i)+"].quadratic", 0.032f);
-    }
-
-    shader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-    shader.setFloat("material.shininess", 32.0f);
-
-    // depthMap: shadows
-    shader.setInt("shadowMap", 2);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-}
-
 // Draw principal scene
-void drawScene(Shader ourShader, Shader metal, Shader glassShader, Shader skyboxShader, Shader lampShader, Shader groundShader, unsigned int skyboxVAO,
- unsigned int cubeVAO, unsigned int planeVAO, unsigned int roofVAO, unsigned int glassWallsVAO, unsigned int cubemapTexture, unsigned int woodTexture, unsigned int marmolTexture, unsigned int woodTableTexture,
- unsigned int roofTexture, glm::vec3 lightPos[], glm::vec3 lightColor[], Camera camera, Model ship, Model nanoSuitModel,
- Model sphere_mirrow, Model table, Model fountain, Model computer, float fov, float aspectRatio, glm::mat4 lightSpaceMatrix, unsigned int depthMap, float rotationAngle) {
-        
-        ourShader.use();
-        ourShader.setVec3("viewPos", camera.Position);
-        setLights(ourShader, lightPos, lightColor, lightSpaceMatrix, depthMap, 4);
+// The view, the lights and the shadow matrix come from the blocks of sceneUniforms, the camera
+// block is set here and stays bound for whatever is drawn after it from the same view.
+void drawScene(const Scene &scene, SceneUniforms &sceneUniforms, const Shader &ourShader, const Shader &skyboxShader, const Shader &lampShader,
+ const Camera &camera, float fov, float aspectRatio, unsigned int depthMap, float rotationAngle) {
 
         // // view/projection transformations
         glm::mat4 projection = glm::perspective(glm::radians(fov), aspectRatio, 0.1f, 200.0f);
         glm::mat4 view = camera.GetViewMatrix();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-
-        // render ship
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, -1.7f, 4.5f));
-        model = glm::scale(model, glm::vec3(0.4f, 0.4f, 0.4f));
-        model = glm::rotate(model, rotationAngle, glm::vec3(0.0, 1.0, 0.0));
-        ourShader.setMat4("model", model);
-        ship.Draw(ourShader);
-
-        //render nanosut
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, -2.0f, -4.5f)); 
-        model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
-        model = glm::rotate(model, rotationAngle, glm::vec3(0.0, 1.0, 0.0));
-        ourShader.setMat4("model", model);
-        nanoSuitModel.Draw(ourShader);
-
-        //render table
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-4.5f, -2.0f, 4.5f));
-        model = glm::scale(model, glm::vec3(0.15f, 0.15f, 0.15f));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0, 0.0, 0.0));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0.0, 0.0, 1.0));
-        ourShader.setMat4("model", model);
-        ourShader.setInt("texture_diffuse1", 0);
-        ourShader.setInt("texture_specular1", 0);
-        ourShader.setInt("shadowMap", 2);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, woodTableTexture);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, depthMap);
-        table.Draw(ourShader);
-
-        //render computer
-        if (!activateMirrow) {
-            model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(-4.5f, -0.8f, 4.5f));
-            model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
-            model = glm::rotate(model, glm::radians(-180.0f), glm::vec3(0.0, 1.0, 0.0));
-            ourShader.setMat4("model", model);
-            ourShader.setInt("texture_diffuse1", 0);
-            ourShader.setInt("texture_specular1", 0);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, marmolTexture);
-            computer.Draw(ourShader);
-        }
+        sceneUniforms.setCamera(projection, view, camera.Position);
 
-        //fountain 1
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(4.5f, -2.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0, 0.0, 0.0));
-        model = glm::scale(model, glm::vec3(0.15f, 0.15f, 0.15f));
-        ourShader.setMat4("model", model);
-        ourShader.setInt("texture_diffuse1", 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, woodTableTexture);
-        fountain.Draw(ourShader);
-
-        //fountain 2
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-4.5f, -2.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0, 0.0, 0.0));
-        model = glm::scale(model, glm::vec3(0.15f, 0.15f, 0.15f));
-        ourShader.setMat4("model", model);
-        ourShader.setInt("texture_diffuse1", 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, marmolTexture);
-        fountain.Draw(ourShader);
-
-        // floor
         ourShader.use();
-        ourShader.setInt("texture_diffuse1", 0);
-        ourShader.setInt("texture_specular1", 0);
-        ourShader.setInt("shadowMap", 1);
-        // material properties
-        ourShader.setFloat("material.shininess", 128.0f);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, -1.5f, 0.0f));
-        ourShader.setMat4("model", model);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, woodTexture);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, depthMap);
-        glBindVertexArray(planeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-
-        //glass walls
-        glassShader.use();
-        glassShader.setMat4("projection", projection);
-        glassShader.setMat4("view", view);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 5.0f, 0.0f));
-        glassShader.setMat4("model", model);
-        glassShader.setInt("skybox", 0);
-        glassShader.setVec3("cameraPos", camera.Position);
+        // depthMap: shadows
+        ourShader.setInt("shadowMap", Scene::SHADOW_MAP_UNIT);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glBindVertexArray(glassWallsVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-
-        // roof
-        ourShader.use();
-        ourShader.setInt("texture_diffuse1", 0);
-        // material properties
-        ourShader.setFloat("material.shininess", 128.0f);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 5.0f, 0.0f));
-        ourShader.setMat4("model", model);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, roofTexture);
-        glBindVertexArray(roofVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
+        // models, floor and roof, each with its material
+        scene.draw(ourShader, depthMap, rotationAngle, activateMirrow);
 
         // also draw the lamp objects
         if (!activateMirrow) {
             lampShader.use();
-            lampShader.setMat4("projection", projection);
-            lampShader.setMat4("view", view);
-            for (int i = 0; i < 4; i++) {
-                lampShader.setVec4("color", lightColor[i].x, lightColor[i].y, lightColor[i].z, 1.0f);
-                model = glm::mat4(1.0f);
-                model = glm::translate(model, lightPos[i]);
+            for (int i = 0; i < SCENE_POINT_LIGHTS; i++) {
+                const glm::vec3 &color = scene.lightColors[i];
+                lampShader.setVec4("color", color.x, color.y, color.z, 1.0f);
+                glm::mat4 model = glm::mat4(1.0f);
+                model = glm::translate(model, scene.lightPositions[i]);
                 model = glm::scale(model, glm::vec3(0.1f)); // a smaller cube
                 lampShader.setMat4("model", model);
-                glBindVertexArray(cubeVAO);
+                glState().bindVertexArray(scene.lampVertexArray);
                 glDrawArrays(GL_TRIANGLES, 0, 36);
-                glBindVertexArray(0);
+                glState().bindVertexArray(0);
             }
         }
 
         // draw skybox as last
         if (!activateMirrow) {
-            glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-            skyboxShader.use();
-            view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // remove translation from the view matrix
-            skyboxShader.setMat4("view", view);
-            skyboxShader.setMat4("projection", projection);
-            glBindVertexArray(skyboxVAO);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+            glState().depthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
+            skyboxShader.use(); // cubemap.vs drops the translation of the view
+            glState().bindVertexArray(scene.skyboxVertexArray);
+            glState().activeTexture(GL_TEXTURE0);
+            glState().bindTexture(GL_TEXTURE_CUBE_MAP, scene.skyboxTexture);
             glDrawArrays(GL_TRIANGLES, 0, 36);
-            glBindVertexArray(0);
-            glDepthFunc(GL_LESS);
+            glState().bindVertexArray(0);
+            glState().depthFunc(GL_LESS);
+        }
+}
+
+// Draw the translucent glass walls, after every opaque object and from the view drawScene
+// bound. With weightedOIT the blend state comes from WeightedBlendedOIT::begin(), otherwise
+// they are alpha blended as they come.
+void drawGlass(const Shader &glassShader, unsigned int glassWallsVAO, GLsizei glassWallsVertices, unsigned int cubemapTexture, bool weightedOIT) {
+        if (!weightedOIT) {
+            glState().enable(GL_BLEND);
+            glState().blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
         }
+
+        glassShader.use();
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, glm::vec3(0.0f, 5.0f, 0.0f));
+        glassShader.setMat4("model", model);
+        glassShader.setInt("skybox", 0);
+        glassShader.setBool("weightedOIT", weightedOIT);
+
+        glState().activeTexture(GL_TEXTURE0);
+        glState().bindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        glState().bindVertexArray(glassWallsVAO);
+        glDrawArrays(GL_TRIANGLES, 0, glassWallsVertices);
+        glState().bindVertexArray(0);
 }
 
 // Draw scene for getting shadows
-void drawSceneDepth(Shader shader, unsigned int planeVAO, glm::vec3 lightPos, Model ship, Model nanoSuitModel,
- Model sphere_mirrow, Model table, Model computer, Model fountain, float rotationAngle) {
+void drawSceneDepth(const Scene &scene, const Shader &shader, float rotationAngle) {
  // don't forget to enable shader before setting uniforms
         shader.use();
-        // render ship
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, -1.7f, 4.5f)); 
-        model = glm::scale(model, glm::vec3(0.4f, 0.4f, 0.4f));	 
-        shader.setMat4("model", model);
-        ship.Draw(shader);
-
-        //render nanosut
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, -2.0f, -4.5f)); 
-        model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));	 
-        model = glm::rotate(model, rotationAngle, glm::vec3(0.0f, 1.0f, 0.0f));
-        shader.setMat4("model", model);
-        nanoSuitModel.Draw(shader);
-
-        // floor
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, -1.5f, 0.0f));
-        shader.setMat4("model", model);
-        glBindVertexArray(planeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        glBindVertexArray(0);
-
-        //render computer
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-4.5f, -0.8f, 4.5f)); 
-        model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));	 
-        model = glm::rotate(model, glm::radians(-180.0f), glm::vec3(0.0, 1.0, 0.0));
-        shader.setMat4("model", model);
-        computer.Draw(shader);
-
-         //render table
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-4.5f, -2.0f, 4.5f)); 
-        model = glm::scale(model, glm::vec3(0.15f, 0.15f, 0.15f));	 
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0, 0.0, 0.0));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0.0, 0.0, 1.0));
-        shader.setMat4("model", model);
-        table.Draw(shader);
-
-        //fountain 1
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(4.5f, -2.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0, 0.0, 0.0));
-        model = glm::scale(model, glm::vec3(0.15f, 0.15f, 0.15f));
-        shader.setMat4("model", model);
-        fountain.Draw(shader);
-
-        //fountain 2
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-4.5f, -2.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0, 0.0, 0.0));
-        model = glm::scale(model, glm::vec3(0.15f, 0.15f, 0.15f));
-        shader.setMat4("model", model);
-        fountain.Draw(shader);
-
-        // sphere
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.3f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
-        shader.setMat4("model", model);
-        sphere_mirrow.Draw(shader);
+        scene.drawDepth(shader, rotationAngle);
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -963,7 +998,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     // make sure the viewport matches the new window dimensions; note that width and 
     // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    glState().viewport(0, 0, width, height);
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -997,7 +1032,7 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 unsigned int getEmptyTexture(unsigned int width, unsigned int height) {
     unsigned int depthMap;
     glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
+    glState().bindTexture(GL_TEXTURE_2D, depthMap);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, 
                 width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -1012,7 +1047,7 @@ unsigned int getEmptyTexture(unsigned int width, unsigned int height) {
 unsigned int createEmptyCubemap(int size) {
     unsigned int textureID;
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    glState().bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
     for (unsigned int i = 0; i < 6; i++)
     {
@@ -1026,7 +1061,7 @@ unsigned int createEmptyCubemap(int size) {
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    glState().bindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
     return textureID;
 }
@@ -1068,36 +1103,11 @@ void switchCam(Camera* cam, int i) {
 // -Y (bottom)
 // +Z (front) 
 // -Z (back)
+// the faces are streamed in by TextureStreamer, see loadTexture
 // -------------------------------------------------------
 unsigned int loadCubemap(vector<std::string> faces)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-    return textureID;
+    return TextureStreamer::instance().loadCubemap(faces);
 }
 
 // checks the status of the currently bound frame buffer object
@@ -1131,41 +1141,10 @@ void checkFBOStatus() {
 	}
 }
 
-// utility function for loading a 2D texture from file
+// utility function for loading a 2D texture from file: it holds a placeholder until the
+// file is decoded on a worker and uploaded by TextureStreamer::update()
 // ---------------------------------------------------
 unsigned int loadTexture(char const * path)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT); 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
+    return TextureStreamer::instance().load2D(path, true);
 }
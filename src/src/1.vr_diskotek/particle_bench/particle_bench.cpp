@@ -0,0 +1,658 @@
+// Headless micro-benchmark of the CPU particle pipeline used by 1.vr_diskotek: spawning,
+// simulation (single threaded in place, or chunked on a worker pool like ParticleSystem),
+// the optional depth sort, and packing the instance data that would be streamed to the GPU.
+// No window or GL context is needed.
+//
+// usage: particle_bench [threads] [frames] [--sort] [--compact] [--precision] [--fluid] [--cache]
+//                       [--emitters N]
+//   threads      workers used by the simulation, 1 runs it in place on the calling thread,
+//                0 (default) uses every hardware thread
+//   frames       measured frames per size (default 30)
+//   --sort       also time the back-to-front sort
+//   --compact    use the quantized CompactParticleStore instead of the float one
+//   --precision  instead of timing, checks that compact trajectories stay within tolerance
+//                of the float ones; the exit code is 1 when they don't
+//   --fluid      instead, steps a 100k particle SPH fountain and reports every step
+//   --cache      instead, bakes a fountain into a particle cache and times its playback; the
+//                exit code is 1 when the played back samples don't match the baked ones
+//   --emitters   instead, steps N emitters of 500k particles through ParticleSystem on 1, 2, 4...
+//                up to threads threads and reports the throughput of each
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <learnopengl/thread_pool.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "particle_store.h"
+#include "particle_compact.h"
+#include "particle_cache.h"
+#include "particle_fluid.h"
+#include "particle_random.h"
+#include "particle_sort.h"
+#include "particle_system.h"
+
+// same emitter settings as ParticleContainer
+const float LIFETIME = 4.0f;
+const float SPREAD = 0.2f;
+const float DELTA = 0.016f;
+const unsigned int CHUNK_SIZE = 16384;
+
+// ------------------------------------------------------------------------
+// allocation counting: every operator new of the process goes through here
+static std::atomic<unsigned long> allocations(0);
+
+#ifdef __GNUC__
+// kept out of line, or gcc pairs the inlined malloc and free and warns about new/delete mismatches
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+BENCH_NOINLINE void* operator new(size_t size)
+{
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+BENCH_NOINLINE void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+// ------------------------------------------------------------------------
+// hardware cache misses of this process (and the threads it starts later), where perf_event is available
+class CacheMissCounter
+{
+public:
+    CacheMissCounter() : fd(-1)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~CacheMissCounter()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    bool available() const { return fd >= 0; }
+
+    void start()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    // misses since start(); the counts of inheriting threads are only folded in when they
+    // exit, so call it after the worker threads are gone
+    unsigned long long stop()
+    {
+        unsigned long long value = 0;
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &value, sizeof(value)) != sizeof(value))
+                value = 0;
+        }
+#endif
+        return value;
+    }
+
+private:
+    int fd;
+};
+
+// ------------------------------------------------------------------------
+// instance data of either store format
+void pack(const ParticleStore &particles, std::vector<unsigned char> &out, const unsigned int *order)
+{
+    out.resize((size_t)particles.capacity * PARTICLE_INSTANCE_FLOATS * sizeof(float));
+    if (order)
+        particles.packInstances((float*)out.data(), order, particles.count);
+    else
+        particles.packInstances((float*)out.data(), particles.first, particles.count);
+}
+
+void pack(const CompactParticleStore &particles, std::vector<unsigned char> &out, const unsigned int *order)
+{
+    out.resize((size_t)particles.capacity * sizeof(CompactParticleInstance));
+    if (order)
+        particles.packInstances((CompactParticleInstance*)out.data(), order, particles.count);
+    else
+        particles.packInstances((CompactParticleInstance*)out.data(), particles.first, particles.count);
+}
+
+// ------------------------------------------------------------------------
+// one emitter of n particles in its steady state, stepped like ParticleContainer + ParticleSystem
+template <class Store>
+class Bench
+{
+public:
+    double spawnTime, simulateTime, sortTime, packTime; // seconds
+
+    // workers == 0 simulates in place on the calling thread, without a pool
+    Bench(unsigned int n, unsigned int workers) : spawnTime(0.0), simulateTime(0.0), sortTime(0.0), packTime(0.0),
+        n(n), random(1)
+    {
+        if (workers > 0)
+            this->pool.reset(new ThreadPool(workers));
+        this->perFrame = (unsigned int)(DELTA * n);
+        this->particles.allocate(n, this->perFrame);
+        this->spare.allocateLike(this->particles);
+        this->randoms.resize(4 * (size_t)this->perFrame);
+        this->survivors.resize(n / CHUNK_SIZE + 2);
+
+        // start full, with ages spread over a lifetime like a fountain that has been running a while
+        std::vector<float> ages(n);
+        this->random.uniform(ages.data(), n, 0.0f, LIFETIME);
+        for (unsigned int i = 0; i < n; i++)
+        {
+            int slot = this->particles.push();
+            this->particles.set(slot, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec4(1.0f), ages[i]);
+        }
+    }
+
+    void frame(bool sort)
+    {
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point t0 = Clock::now();
+        spawn();
+        Clock::time_point t1 = Clock::now();
+        simulate();
+        Clock::time_point t2 = Clock::now();
+        if (sort)
+            this->sorter.sort(this->particles, glm::vec3(0.0f, 1.0f, 5.0f));
+        Clock::time_point t3 = Clock::now();
+        pack(this->particles, this->instances, sort ? this->sorter.order.data() : NULL);
+        Clock::time_point t4 = Clock::now();
+
+        this->spawnTime += std::chrono::duration<double>(t1 - t0).count();
+        this->simulateTime += std::chrono::duration<double>(t2 - t1).count();
+        this->sortTime += std::chrono::duration<double>(t3 - t2).count();
+        this->packTime += std::chrono::duration<double>(t4 - t3).count();
+    }
+
+private:
+    unsigned int n;
+    unsigned int perFrame;
+    std::unique_ptr<ThreadPool> pool; // NULL without workers
+    Store particles, spare;
+    ParticleRandom random;
+    ParticleSorter sorter;
+    std::vector<unsigned char> instances;
+    std::vector<float> randoms;
+    std::vector<unsigned int> survivors;
+
+    // ParticleContainer::generateParticles with the recycle-oldest overflow policy
+    void spawn()
+    {
+        unsigned int count = this->perFrame;
+        float* dirs = this->randoms.data();
+        float* colors = dirs + 3 * count;
+        this->random.uniform(dirs, 3 * count, -1.0f, 1.0f);
+        this->random.uniform(colors, count, 0.5f, 1.5f);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            if (this->particles.count == this->particles.capacity)
+                this->particles.retireOldest();
+            int slot = this->particles.push();
+            glm::vec3 speed = glm::vec3(0.0f, 1.0f, 0.0f) + glm::vec3(dirs[i], dirs[count + i], dirs[2 * count + i]) * SPREAD;
+            this->particles.set(slot, glm::vec3(0.0f), speed, glm::vec4(colors[i], colors[i], colors[i], 1.0f), LIFETIME);
+        }
+    }
+
+    // ParticleSystem's two phase chunked step, or one in place pass without workers
+    void simulate()
+    {
+        if (!this->pool)
+        {
+            this->particles.simulate(DELTA);
+            return;
+        }
+        unsigned int base = this->particles.first / CHUNK_SIZE * CHUNK_SIZE;
+        unsigned int chunks = (this->particles.first + this->particles.count - base + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        for (unsigned int c = 0; c < chunks; c++)
+        {
+            this->pool->submit([this, base, c] {
+                unsigned int begin = base + c * CHUNK_SIZE;
+                this->survivors[c] = this->particles.integrate(begin, begin + CHUNK_SIZE, DELTA);
+            });
+        }
+        this->pool->wait();
+
+        unsigned int offset = 0;
+        for (unsigned int c = 0; c < chunks; c++)
+        {
+            unsigned int alive = this->survivors[c];
+            this->survivors[c] = offset;
+            offset += alive;
+        }
+        this->spare.first = 0;
+        this->spare.count = offset;
+        for (unsigned int c = 0; c < chunks; c++)
+        {
+            this->pool->submit([this, base, c] {
+                unsigned int begin = base + c * CHUNK_SIZE;
+                this->particles.gather(begin, begin + CHUNK_SIZE, this->spare, this->survivors[c]);
+            });
+        }
+        this->pool->wait();
+        this->particles.swap(this->spare);
+    }
+};
+
+// times every size with the given store format
+template <class Store>
+void benchmark(unsigned int workers, unsigned int frames, bool sort)
+{
+    const unsigned int sizes[] = { 5000, 50000, 500000, 5000000 };
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        unsigned int n = sizes[s];
+        // opened before the pool starts so the workers inherit it
+        CacheMissCounter misses;
+        Bench<Store>* bench = new Bench<Store>(n, workers);
+        bench->frame(sort); // warm up: first touch of the buffers, sorter allocations
+        bench->spawnTime = bench->simulateTime = bench->sortTime = bench->packTime = 0.0;
+
+        unsigned long allocationsBefore = allocations;
+        misses.start();
+        for (unsigned int f = 0; f < frames; f++)
+            bench->frame(sort);
+        double frameAllocations = (double)(allocations - allocationsBefore) / frames;
+        double times[4] = { bench->spawnTime, bench->simulateTime, bench->sortTime, bench->packTime };
+        delete bench; // joins the workers
+        unsigned long long missCount = misses.stop();
+
+        double scale = 1e9 / ((double)n * frames);
+        double total = times[0] + times[1] + times[2] + times[3];
+        printf("%10u %10.2f %10.2f %10.2f %10.2f %10.2f %13.1f ",
+            n, times[0] * scale, times[1] * scale, times[2] * scale, times[3] * scale, total * scale, frameAllocations);
+        if (misses.available())
+            printf("%14llu\n", missCount / frames);
+        else
+            printf("%14s\n", "n/a");
+    }
+}
+
+// Spawns the same burst of particles into a float and a compact store, like a fountain of the
+// demo, and steps both until they die. Positions may drift by 1% of their distance to the
+// emitter plus 1 cm, and both bursts must die within a frame of each other.
+bool checkPrecision()
+{
+    const unsigned int n = 5000;
+    const glm::vec3 origin(4.5f, 1.0f, 0.0f);
+    ParticleStore reference(n);
+    CompactParticleStore compact(n);
+    compact.origin = origin;
+
+    ParticleRandom random(1);
+    std::vector<float> randoms(4 * n);
+    random.uniform(randoms.data(), 3 * n, -1.0f, 1.0f);
+    random.uniform(randoms.data() + 3 * n, n, 0.5f, 1.5f);
+    for (unsigned int i = 0; i < n; i++)
+    {
+        glm::vec3 speed = glm::vec3(0.0f, 1.0f, 0.0f) + glm::vec3(randoms[i], randoms[n + i], randoms[2 * n + i]) * SPREAD;
+        glm::vec4 color(randoms[3 * n + i], randoms[3 * n + i], randoms[3 * n + i], 1.0f);
+        reference.set(reference.push(), origin, speed, color, LIFETIME);
+        compact.set(compact.push(), origin, speed, color, LIFETIME);
+    }
+
+    float maxError = 0.0f, maxRelative = 0.0f;
+    bool inTolerance = true;
+    int referenceDeath = -1, compactDeath = -1;
+    for (int frame = 1; referenceDeath < 0 || compactDeath < 0; frame++)
+    {
+        reference.simulate(DELTA);
+        compact.simulate(DELTA);
+        if (reference.count == 0 && referenceDeath < 0)
+            referenceDeath = frame;
+        if (compact.count == 0 && compactDeath < 0)
+            compactDeath = frame;
+        if (reference.count != n || compact.count != n)
+            continue;
+        for (unsigned int i = 0; i < n; i++)
+        {
+            glm::vec3 expected = reference.position(i);
+            float error = glm::length(compact.position(i) - expected);
+            float distance = glm::length(expected - origin);
+            maxError = std::max(maxError, error);
+            maxRelative = std::max(maxRelative, error / std::max(distance, 1.0f));
+            if (error > 0.01f * distance + 0.01f)
+                inTolerance = false;
+        }
+    }
+
+    printf("compact vs float, %u particles over %.1f s:\n", n, LIFETIME);
+    printf("  max position error %.4f m, %.3f%% of the distance to the emitter\n", maxError, maxRelative * 100.0f);
+    printf("  all dead after %d frames (float) and %d frames (compact)\n", referenceDeath, compactDeath);
+    printf("  state %u vs %u bytes per particle, instances %u vs %u bytes\n",
+        11u * (unsigned int)sizeof(float), 7u * (unsigned int)sizeof(uint16_t) + (unsigned int)sizeof(uint32_t),
+        PARTICLE_INSTANCE_FLOATS * (unsigned int)sizeof(float), (unsigned int)sizeof(CompactParticleInstance));
+    bool pass = inTolerance && std::abs(referenceDeath - compactDeath) <= 1;
+    printf("%s\n", pass ? "within tolerance" : "OUT OF TOLERANCE");
+    return pass;
+}
+
+// A fountain of n particles with SPH interactions, emitting like the demo's fountains with the
+// spray landing on the floor. It runs a lifetime first so the pool on the floor has formed, then
+// prints the ParticleFluid statistics of every measured step.
+void benchmarkFluid(unsigned int workers, unsigned int frames)
+{
+    const unsigned int n = 100000;
+    const glm::vec3 origin(0.0f, 1.0f, 0.0f);
+    const unsigned int perFrame = (unsigned int)(n / LIFETIME * DELTA);
+    // ThreadPool(0) would start a worker per core, so without workers there is no pool at all
+    std::unique_ptr<ThreadPool> pool(workers > 0 ? new ThreadPool(workers) : NULL);
+    ParticleStore particles(n, perFrame);
+    ParticleFluid fluid;
+    ParticleRandom random(1);
+    std::vector<float> randoms(4 * perFrame);
+
+    unsigned int warmup = (unsigned int)(LIFETIME / DELTA);
+    printf("%u particle SPH fountain, %u threads, h = %.2f m, %u warm-up frames\n", n, workers + 1, fluid.smoothingRadius, warmup);
+    printf("%6s %10s %10s %10s %10s %10s %10s %12s\n",
+        "step", "particles", "substeps", "grid ms", "neighb ms", "step ms", "neighbors", "particles/s");
+    float maxSpeed = 0.0f;
+    for (unsigned int frame = 0; frame < warmup + frames; frame++)
+    {
+        random.uniform(randoms.data(), 3 * perFrame, -1.0f, 1.0f);
+        for (unsigned int i = 0; i < perFrame; i++)
+        {
+            if (particles.count == particles.capacity)
+                particles.retireOldest();
+            glm::vec3 speed = glm::vec3(0.0f, 1.0f, 0.0f) + glm::vec3(randoms[i], randoms[perFrame + i], randoms[2 * perFrame + i]) * SPREAD;
+            particles.set(particles.push(), origin, speed, glm::vec4(1.0f), LIFETIME);
+        }
+
+        if (!pool)
+        {
+            fluid.step(particles, DELTA);
+        }
+        else
+        {
+            fluid.schedule(*pool, particles, DELTA, std::function<void()>());
+            pool->wait();
+        }
+        if (frame < warmup)
+            continue;
+
+        const ParticleFluidStats &stats = fluid.stats;
+        printf("%6u %10u %10u %10.2f %10.2f %10.2f %10.1f %12.0f\n", frame - warmup, stats.particles, stats.substeps,
+            stats.gridSeconds * 1e3, stats.neighborSeconds * 1e3, stats.stepSeconds * 1e3, stats.averageNeighbors, stats.particlesPerSecond);
+        for (unsigned int i = particles.first; i < particles.first + particles.count; i++)
+            maxSpeed = std::max(maxSpeed, glm::length(glm::vec3(particles.speedX[i], particles.speedY[i], particles.speedZ[i])));
+    }
+    printf("fastest particle over the measured steps: %.2f m/s\n", maxSpeed);
+}
+
+// Bakes 10 s of a fountain into a cache file, then plays it back in a loop for as many frames as
+// the fountain lasts twice. The samples are checked against snapshots taken while baking, and the
+// unpack time and the resident window are reported.
+bool benchmarkCache()
+{
+    const unsigned int n = 20000;
+    const float rate = 30.0f;
+    const float seconds = 10.0f;
+    const char* path = "particle_bench.pcache";
+    const glm::vec3 origin(4.5f, 1.0f, 0.0f);
+    const unsigned int perFrame = (unsigned int)(n / LIFETIME * DELTA);
+    ParticleStore particles(n, perFrame);
+    ParticleRandom random(1);
+    std::vector<float> randoms(4 * perFrame);
+    unsigned long long spawned = 0;
+
+    // a few samples kept to compare the playback against
+    const unsigned int checked[] = { 1, 100, 200 };
+    const unsigned int nrChecked = sizeof(checked) / sizeof(checked[0]);
+    std::vector<float> snapshots[nrChecked];
+
+    ParticleCacheWriter writer;
+    if (!writer.open(path, rate, origin))
+        return false;
+    for (float time = 0.0f; time < seconds; time += DELTA)
+    {
+        random.uniform(randoms.data(), 3 * perFrame, -1.0f, 1.0f);
+        random.uniform(randoms.data() + 3 * perFrame, perFrame, 0.5f, 1.5f);
+        for (unsigned int i = 0; i < perFrame; i++)
+        {
+            if (particles.count == particles.capacity)
+                particles.retireOldest();
+            glm::vec3 speed = glm::vec3(0.0f, 1.0f, 0.0f) + glm::vec3(randoms[i], randoms[perFrame + i], randoms[2 * perFrame + i]) * SPREAD;
+            float c = randoms[3 * perFrame + i];
+            particles.set(particles.push(), origin, speed, glm::vec4(c, c, c, 1.0f), LIFETIME);
+            spawned++;
+        }
+        particles.simulate(DELTA);
+
+        unsigned int before = writer.frameCount();
+        writer.record(DELTA, particles, spawned - particles.count);
+        for (unsigned int k = 0; k < nrChecked; k++)
+        {
+            if (writer.frameCount() == before + 1 && before == checked[k])
+            {
+                snapshots[k].resize((size_t)particles.count * PARTICLE_INSTANCE_FLOATS);
+                particles.packInstances(snapshots[k].data(), particles.first, particles.count);
+            }
+        }
+    }
+    writer.close();
+
+    ParticleCache cache;
+    if (!cache.open(path))
+        return false;
+    size_t fileBytes = 0;
+    if (FILE* file = fopen(path, "rb"))
+    {
+        fseek(file, 0, SEEK_END);
+        fileBytes = (size_t)ftell(file);
+        fclose(file);
+    }
+    printf("%u particle fountain baked at %.0f samples/s: %u samples, %.1f s, %.1f MB\n",
+        n, rate, cache.frameCount(), cache.duration(), fileBytes / 1048576.0);
+
+    // the samples come back within the fp16 / RGBA8 quantization of what was baked
+    std::vector<float> instances((size_t)cache.maxParticles() * PARTICLE_INSTANCE_FLOATS);
+    float maxPosition = 0.0f, maxColor = 0.0f;
+    bool match = true;
+    for (unsigned int k = 0; k < nrChecked; k++)
+    {
+        cache.seek(checked[k] / rate);
+        unsigned int count = cache.unpack(instances.data(), cache.maxParticles());
+        if (snapshots[k].empty() || count * PARTICLE_INSTANCE_FLOATS != snapshots[k].size())
+        {
+            match = false;
+            continue;
+        }
+        for (unsigned int i = 0; i < count; i++)
+        {
+            const float* a = &instances[i * PARTICLE_INSTANCE_FLOATS];
+            const float* b = &snapshots[k][i * PARTICLE_INSTANCE_FLOATS];
+            // fp16 keeps 11 bits of the offset from the emitter
+            float error = glm::length(glm::vec3(a[0], a[1], a[2]) - glm::vec3(b[0], b[1], b[2]));
+            maxPosition = std::max(maxPosition, error);
+            if (error > 1e-3f * glm::length(glm::vec3(b[0], b[1], b[2]) - origin) + 1e-3f)
+                match = false;
+            for (unsigned int c = 3; c < PARTICLE_INSTANCE_FLOATS; c++)
+                maxColor = std::max(maxColor, std::abs(a[c] - b[c]));
+        }
+    }
+    match = match && maxColor <= PARTICLE_COLOR_RANGE / 255.0f;
+    printf("  samples %s: max position error %.4f m, max color error %.4f\n", match ? "match" : "DO NOT MATCH", maxPosition, maxColor);
+
+    // playback in a loop, like the demo does every frame
+    typedef std::chrono::steady_clock Clock;
+    unsigned int frames = (unsigned int)(2.0f * cache.duration() / DELTA);
+    unsigned long long unpacked = 0;
+    size_t maxResident = 0;
+    cache.seek(0.0f);
+    Clock::time_point start = Clock::now();
+    for (unsigned int f = 0; f < frames; f++)
+    {
+        cache.advance(DELTA);
+        unpacked += cache.unpack(instances.data(), cache.maxParticles());
+        maxResident = std::max(maxResident, cache.residentBytes());
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    printf("  playback: %u frames, %.2f ms/frame, %.2f ns/particle, at most %.2f MB kept resident\n",
+        frames, elapsed * 1e3 / frames, elapsed * 1e9 / std::max(unpacked, 1ULL), maxResident / 1048576.0);
+
+    cache.close();
+    remove(path);
+    return match;
+}
+
+// Steps emitters of 500k particles, in their steady state, through ParticleSystem on a growing
+// number of threads. Their chunks are integrated, gathered and swapped by the pool like in the
+// demo, only spawning runs on the calling thread.
+void benchmarkEmitters(unsigned int emitters, unsigned int threads, unsigned int frames, bool sort, bool compact)
+{
+    const unsigned int n = 500000;
+    const glm::vec3 cameraPos(0.0f, 2.0f, 10.0f);
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+    const glm::mat4 view = glm::lookAt(cameraPos, glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    printf("%u emitters of %u particles, %u frames, SIMD width %u%s%s\n", emitters, n, frames, PARTICLE_SIMD_WIDTH,
+        compact ? ", compact" : "", sort ? ", sorted" : "");
+    printf("%10s %10s %12s %10s %10s\n", "threads", "ms/frame", "particles/s", "speedup", "efficiency");
+    double single = 0.0;
+    for (unsigned int t = 1; t <= threads; t = t < threads && t * 2 > threads ? threads : t * 2)
+    {
+        // the calling thread works on the queue in wait(), so t threads are t - 1 workers
+        ParticleSystem system(0, t == 1 ? THREAD_POOL_NO_WORKERS : t - 1);
+        system.minEmission = 1.0f; // full emission however small the emitters are on screen
+        for (unsigned int e = 0; e < emitters; e++)
+            system.add(new ParticleContainer(glm::vec3(e * 0.5f, 1.0f, 0.0f), n, e + 1, compact ? PARTICLE_FORMAT_COMPACT : PARTICLE_FORMAT_FLOAT));
+        if (!sort)
+            system.setBlend(PARTICLE_BLEND_ADDITIVE);
+
+        // run until every pool is full, then a few more frames so the oldest are being recycled
+        unsigned int warmup = 0;
+        for (; system.liveParticles < emitters * n && warmup < (unsigned int)(LIFETIME / DELTA); warmup++)
+        {
+            system.simulateAsync(DELTA, cameraPos, projection, view);
+            system.wait();
+        }
+        for (unsigned int f = 0; f < 4; f++)
+        {
+            system.simulateAsync(DELTA, cameraPos, projection, view);
+            system.wait();
+        }
+
+        typedef std::chrono::steady_clock Clock;
+        unsigned long long simulated = 0;
+        Clock::time_point start = Clock::now();
+        for (unsigned int f = 0; f < frames; f++)
+        {
+            system.simulateAsync(DELTA, cameraPos, projection, view);
+            system.wait();
+            simulated += system.liveParticles;
+        }
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        if (t == 1)
+            single = elapsed;
+        printf("%10u %10.2f %12.0f %10.2f %9.0f%%\n", t, elapsed * 1e3 / frames, simulated / elapsed,
+            single / elapsed, single / elapsed / t * 100.0);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int threads = 0;
+    unsigned int frames = 30;
+    bool sort = false;
+    bool compact = false;
+    bool fluid = false;
+    unsigned int emitters = 0;
+    unsigned int positional = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--sort") == 0)
+            sort = true;
+        else if (strcmp(argv[i], "--compact") == 0)
+            compact = true;
+        else if (strcmp(argv[i], "--precision") == 0)
+            return checkPrecision() ? 0 : 1;
+        else if (strcmp(argv[i], "--fluid") == 0)
+            fluid = true;
+        else if (strcmp(argv[i], "--cache") == 0)
+            return benchmarkCache() ? 0 : 1;
+        else if (strcmp(argv[i], "--emitters") == 0 && i + 1 < argc)
+            emitters = (unsigned int)atoi(argv[++i]);
+        else if (positional++ == 0)
+            threads = (unsigned int)atoi(argv[i]);
+        else
+            frames = (unsigned int)atoi(argv[i]);
+    }
+    if (frames == 0)
+        frames = 1;
+    // the pool counts workers besides the calling thread
+    unsigned int workers = threads == 0 ? 0 : threads - 1;
+    if (threads == 0)
+    {
+        unsigned int hardware = std::thread::hardware_concurrency();
+        threads = hardware > 0 ? hardware : 1;
+        workers = threads - 1;
+    }
+
+    if (fluid)
+    {
+        benchmarkFluid(workers, frames);
+        return 0;
+    }
+    if (emitters > 0)
+    {
+        benchmarkEmitters(emitters, threads, frames, sort, compact);
+        return 0;
+    }
+
+    printf("%u threads, %u frames, SIMD width %u%s%s\n", threads, frames, PARTICLE_SIMD_WIDTH,
+        compact ? ", compact" : "", sort ? ", sorted" : "");
+    printf("%10s %10s %10s %10s %10s %10s %13s %14s\n",
+        "particles", "spawn", "simulate", "sort", "pack", "total", "allocs/frame", "misses/frame");
+    printf("%10s %10s %10s %10s %10s %10s\n", "", "ns/part", "ns/part", "ns/part", "ns/part", "ns/part");
+
+    if (compact)
+        benchmark<CompactParticleStore>(workers, frames, sort);
+    else
+        benchmark<ParticleStore>(workers, frames, sort);
+    return 0;
+}